@@ -0,0 +1,146 @@
+// board.cpp
+//
+// This file contains the bitboard of the bin.
+// The rows are bitmasks with the walls and the floor built in,
+// so the collision test does not need any bound check.
+//
+
+#include <string.h> // memcpy
+#include "board.hpp"
+
+// ================================================================================= //
+// Constructor
+//
+// It allocates the rows including the margins above and below the bin,
+// and clears the bin.
+// note: ncol must be small enough for a row to fit in 64 bits with the walls.
+// ================================================================================= //
+BOARD::BOARD(int nrow, int ncol): nrow(nrow), ncol(ncol)
+{
+    rows = new uint64_t[nrow + 2*NROW_PIECE];
+    mask_cols = ((((uint64_t)1) << ncol) - 1) << PAD;
+    clear();
+}
+
+// ================================================================================= //
+// Copy constructor / assignment
+//
+// A board is copied deeply, so that a copy can be played on without touching the original.
+// (e.g., trying drops of a piece in a simulation)
+// ================================================================================= //
+BOARD::BOARD(const BOARD &src): nrow(src.nrow), ncol(src.ncol), mask_cols(src.mask_cols)
+{
+    rows = new uint64_t[nrow + 2*NROW_PIECE];
+    memcpy(rows, src.rows, sizeof(uint64_t)*(nrow + 2*NROW_PIECE));
+}
+
+BOARD& BOARD::operator=(const BOARD &src)
+{
+    if(this == &src)
+        return *this;
+    if(nrow != src.nrow)
+    {
+        delete[] rows;
+        rows = new uint64_t[src.nrow + 2*NROW_PIECE];
+    }
+    nrow = src.nrow;
+    ncol = src.ncol;
+    mask_cols = src.mask_cols;
+    memcpy(rows, src.rows, sizeof(uint64_t)*(nrow + 2*NROW_PIECE));
+    return *this;
+}
+
+// ================================================================================= //
+// Destructor
+// ================================================================================= //
+BOARD::~BOARD()
+{
+    delete[] rows;
+}
+
+// ================================================================================= //
+// clear
+//
+// It empties the bin.
+// The rows above the bin have only the walls. The rows below the bin are full.
+// ================================================================================= //
+void BOARD::clear()
+{
+    for(int y = -NROW_PIECE; y < nrow; y++)
+        rows[y + NROW_PIECE] = ~mask_cols;
+    for(int y = nrow; y < nrow + NROW_PIECE; y++)
+        rows[y + NROW_PIECE] = ~((uint64_t)0);
+}
+
+// ================================================================================= //
+// collides
+//
+// It returns true if the piece at (x, y) overlaps the existing cells, the walls,
+// or the floor. Like the original check, the ceiling is not cared.
+// note: it assumes y >= -NROW_PIECE and x >= -PAD
+// ================================================================================= //
+bool BOARD::collides(PIECE_MASK piece, int x, int y) const
+{
+    const uint64_t *r = rows + y + NROW_PIECE;
+    int shift = x + PAD;
+    for(int i = 0; i < NROW_PIECE; i++)
+    {
+        uint64_t prow = (piece >> (NCOL_PIECE*i)) & 0xF;
+        if(prow != 0 && ((prow << shift) & r[i]) != 0)
+            return true;
+    }
+    return false;
+}
+
+// ================================================================================= //
+// place
+//
+// It fills the cells of the piece at (x, y).
+// ================================================================================= //
+void BOARD::place(PIECE_MASK piece, int x, int y)
+{
+    uint64_t *r = rows + y + NROW_PIECE;
+    int shift = x + PAD;
+    for(int i = 0; i < NROW_PIECE; i++)
+        r[i] |= ((uint64_t)((piece >> (NCOL_PIECE*i)) & 0xF)) << shift;
+}
+
+// ================================================================================= //
+// isFull
+//
+// It tells if all cells of the row y are filled.
+// ================================================================================= //
+bool BOARD::isFull(int y) const
+{
+    return (rows[y + NROW_PIECE] & mask_cols) == mask_cols;
+}
+
+// ================================================================================= //
+// moveRow
+//
+// It overwrites the row dst with the row src.
+// ================================================================================= //
+void BOARD::moveRow(int src, int dst)
+{
+    rows[dst + NROW_PIECE] = rows[src + NROW_PIECE];
+}
+
+// ================================================================================= //
+// clearRow
+//
+// It empties the row y.
+// ================================================================================= //
+void BOARD::clearRow(int y)
+{
+    rows[y + NROW_PIECE] = ~mask_cols;
+}
+
+// ================================================================================= //
+// setRow
+//
+// It sets the occupied cells of the row y. (the bit c is the column c)
+// ================================================================================= //
+void BOARD::setRow(int y, uint64_t bits)
+{
+    rows[y + NROW_PIECE] = ~mask_cols | ((bits << PAD) & mask_cols);
+}
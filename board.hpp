@@ -0,0 +1,60 @@
+// board.hpp
+//
+// A bitboard of the bin.
+// Each row of the bin is a bitmask of the occupied cells,
+// and each piece is a 16-bit mask of its 4x4 cells.
+// So a collision test is a few shifts and ANDs instead of a loop over 16 cells.
+// The colors of the cells are not stored here. They are only needed for drawing.
+//
+
+#ifndef _BOARD_HPP
+#define _BOARD_HPP
+
+#include <stdint.h>
+#include "dimension.hpp"
+#include "pieces.hpp"
+
+class BOARD
+{
+private:
+    // the column c of the bin is the bit (c + PAD) of a row.
+    // the bits below PAD stand for the left wall, so that a piece sticking out
+    // of the bin on the left can be shifted without going negative.
+    static const int PAD = NCOL_PIECE;
+
+    // # of rows and # of columns of the bin
+    int nrow;
+    int ncol;
+
+    // rows[y + NROW_PIECE]: the bitmask of the row y.
+    // NROW_PIECE rows above the bin have only the walls (a piece can stay there),
+    // and NROW_PIECE rows below the bin are filled up (the floor).
+    uint64_t *rows;
+
+    // the bits of the columns in the bin
+    uint64_t mask_cols;
+
+public:
+    // the widest bin: a piece sticking out on the right needs NCOL_PIECE bits above the bin
+    static const int MAX_NCOL = 64 - PAD - NCOL_PIECE;
+
+    BOARD(int nrow, int ncol);
+    BOARD(const BOARD &src);
+    BOARD& operator=(const BOARD &src);
+    ~BOARD();
+
+    void clear();
+    bool collides(PIECE_MASK piece, int x, int y) const;
+    void place(PIECE_MASK piece, int x, int y);
+    bool isFull(int y) const;
+    void moveRow(int src, int dst);
+    void clearRow(int y);
+    void setRow(int y, uint64_t bits);
+
+    int getNRow() const { return nrow; }
+    int getNCol() const { return ncol; }
+    // the occupied cells of the row y (the bit c is the column c)
+    uint64_t row(int y) const { return (rows[y + NROW_PIECE] & mask_cols) >> PAD; }
+};
+
+#endif //_BOARD_HPP
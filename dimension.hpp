@@ -0,0 +1,19 @@
+// dimension.hpp
+//
+// The sizes of the bin and of a piece, in cells.
+// They are shared by the engine and by the drawing, and depend on neither.
+//
+
+#ifndef _DIMENSION_HPP
+#define _DIMENSION_HPP
+
+// nrow of the bin (the default; -d of each program can change it)
+#define NROW_BIN 13
+// ncol of the bin (the default)
+#define NCOL_BIN 11
+// nrow of a piece
+#define NROW_PIECE 4
+// ncol of a piece
+#define NCOL_PIECE 4
+
+#endif //_DIMENSION_HPP
@@ -0,0 +1,404 @@
+// engine.cpp
+//
+// This file contains the rules of the game.
+// Nothing here draws anything. The state changes only through step(),
+// and step() reports what happened so that a UI can decide what to redraw.
+//
+
+#include "engine.hpp"
+
+#include <stdlib.h> // posix_memalign, free
+#include <string.h> // memcpy, memset
+#include <new> // bad_alloc
+
+// ================================================================================= //
+// Constructor
+//
+// It allocates the color plane of the bin on a cache line and the bitboard.
+// Then, it seeds the random number generator of this game,
+// and initializes the internal parameters.
+// The same seed always gives the same sequence of pieces.
+// ================================================================================= //
+ENGINE::ENGINE(int nrow, int ncol, uint32_t seed): nrow(nrow), ncol(ncol), rng(seed), rng_seed(seed), f_bag(false), bag_pos(N_SHAPE)
+{
+    size_t plane_size = (nrow*ncol + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *block = NULL;
+    // out of memory is an exception as it is for new (BOARD below)
+    if(posix_memalign(&block, CACHE_LINE, plane_size) != 0)
+        throw std::bad_alloc();
+    bin = (uint8_t*)block;
+    board = new BOARD(nrow, ncol);
+
+    init_stat();
+}
+
+// ================================================================================= //
+// Destructor
+// ================================================================================= //
+ENGINE::~ENGINE()
+{
+    free(bin);
+    delete board;
+}
+
+// ================================================================================= //
+// seed
+//
+// It changes the seed of the game. (call init_stat to restart the game with it)
+// ================================================================================= //
+void ENGINE::seed(uint32_t seed)
+{
+    rng_seed = seed;
+}
+
+// ================================================================================= //
+// setBag
+//
+// It turns the 7-bag mode on or off. (it takes effect from the next bag)
+// ================================================================================= //
+void ENGINE::setBag(bool on)
+{
+    f_bag = on;
+    bag_pos = N_SHAPE;
+}
+
+// ================================================================================= //
+// init_stat
+//
+// initializes all internal parameters.
+// the random number generator starts over from the seed,
+// so a game is decided only by the seed and the actions given to it.
+// ================================================================================= //
+void ENGINE::init_stat()
+{
+    rng.seed(rng_seed);
+    memset(bin, 0, nrow*ncol);
+    board->clear();
+
+    count_clearing_rows = 0;
+    count_pieces = 0;
+    for(int k = 0; k <= NROW_PIECE; k++)
+        count_by_rows[k] = 0;
+    placed_p_y = 0;
+    bag_pos = N_SHAPE;
+    f_stat = 1;
+    rand_next();
+    copy_pieces();
+    rand_next();
+}
+
+// ================================================================================= //
+// load
+//
+// It sets up a position: the colors of the bin (nrow x ncol in row-major order, 0: empty),
+// and the current piece at (x, y).
+// The bitboard is rebuilt from the colors. The next piece and the counts are kept.
+// (e.g., to start from a given board in benchmarks)
+// ================================================================================= //
+void ENGINE::load(const uint8_t *colors, int shape, int rot, int x, int y)
+{
+    memcpy(bin, colors, nrow*ncol);
+    board->clear();
+    for(int r = 0; r < nrow; r++)
+    {
+        uint64_t bits = 0;
+        for(int c = 0; c < ncol; c++)
+            if(colors[r*ncol + c] != 0)
+                bits |= ((uint64_t)1) << c;
+        board->setRow(r, bits);
+    }
+    cur_shape = shape;
+    cur_rot = rot;
+    cur_p_x = x;
+    cur_p_y = y;
+    placed_p_y = (y < 0)? 0: y;
+    f_stat = 1;
+}
+
+// ================================================================================= //
+// step
+//
+// This function advances the game by the given action.
+//
+// A move or a turn happens only if the piece is not blocked.
+// On ACT_GRAVITY, it checks if the current piece can fall by one cell.
+// If so, just let it go.
+// Otherwise, it checks if the current piece is off the area of the bin.
+// If so, the game is over.
+// Otherwise, it places the current piece in the bin, and evaluates the game.
+//
+// input:
+//   ACTION act: the action to take
+// output:
+//   the events which happened (EV_MOVED, EV_LOCKED, EV_CLEARED, EV_OVER)
+//   0 if nothing changed
+// ================================================================================= //
+int ENGINE::step(ACTION act)
+{
+    if(!isRunning())
+        return 0;
+
+    int events = 0;
+    switch(act)
+    {
+    case ACT_LEFT:
+        if(isMovable(-1,0))
+        {
+            cur_p_x--;
+            events = EV_MOVED;
+        }
+        break;
+    case ACT_RIGHT:
+        if(isMovable(1,0))
+        {
+            cur_p_x++;
+            events = EV_MOVED;
+        }
+        break;
+    case ACT_DOWN:
+        if(isMovable(0,1))
+        {
+            cur_p_y++;
+            events = EV_MOVED;
+        }
+        break;
+    case ACT_ROT_R:
+        if(isRotatable(true))
+        {
+            cur_rot = ROT_R(cur_rot);
+            events = EV_MOVED;
+        }
+        break;
+    case ACT_ROT_L:
+        if(isRotatable(false))
+        {
+            cur_rot = ROT_L(cur_rot);
+            events = EV_MOVED;
+        }
+        break;
+    case ACT_GRAVITY:
+        if(isMovable(0,1))
+        {
+            cur_p_y++;
+            events = EV_MOVED;
+        }
+        else if(cur_p_y < 0)
+        {
+            f_stat = 0;
+            events = EV_OVER;
+        }
+        else
+        {
+            placePiece();
+            copy_pieces();
+            rand_next();
+            events = EV_LOCKED;
+            if(eval_and_clean() > 0)
+                events |= EV_CLEARED;
+        }
+        break;
+    default:
+        break;
+    }
+    return events;
+}
+
+// ================================================================================= //
+// isRunning
+//
+// it tells if the game is running or not
+// ================================================================================= //
+int ENGINE::isRunning() const
+{
+    return (f_stat == 1)? 1: 0;
+}
+
+// ================================================================================= //
+// rand_next()
+//
+// It generates a randomized piece in the next box.
+// Each shape appears at a chance of 1/7, and it is turned randomly.
+// In the 7-bag mode, the shape is the next one in the shuffled bag instead.
+// The numbers come from the generator of this game, and only integers are used.
+// 
+// ================================================================================= //
+void ENGINE::rand_next()
+{
+    // colors: 1-6 and 11-16
+    int color = rng.below(12);
+    if(color < 6) color++;
+    else color += 5;
+
+    if(f_bag)
+    {
+        if(bag_pos >= N_SHAPE)
+        {
+            // refill and shuffle (Fisher-Yates)
+            for(int i = 0; i < N_SHAPE; i++)
+                bag[i] = i;
+            for(int i = N_SHAPE - 1; i > 0; i--)
+            {
+                int j = rng.below(i + 1);
+                uint8_t t = bag[i]; bag[i] = bag[j]; bag[j] = t;
+            }
+            bag_pos = 0;
+        }
+        next_shape = bag[bag_pos++];
+    }
+    else
+        next_shape = rng.below(N_SHAPE);
+    next_rot = rng.below(N_ROT);
+    next_color = color;
+}
+
+// ================================================================================= //
+// copy_pieces()
+//
+// It copies a piece in the next box to the current box.
+// Then, it initializes the curr piece's location.
+// ================================================================================= //
+void ENGINE::copy_pieces()
+{
+    cur_shape = next_shape;
+    cur_rot = next_rot;
+    cur_color = next_color;
+    cur_p_x = (ncol - NCOL_PIECE)/2;
+    cur_p_y = -1*NROW_PIECE;
+}
+
+// ================================================================================= //
+// compact_rows
+//
+// It removes the full rows at and above irow_low from the colors and the bitboard,
+// moving each surviving row to its final position at once, and clearing the rows on top.
+// It returns the number of removed rows.
+//
+// NCOL is the width of the bin known at compile time (0: given by ncol at run time).
+// With a constant width, the copies of a row are inlined.
+// ================================================================================= //
+template <int NCOL>
+static int compact_rows(uint8_t *bin, BOARD *board, int irow_low, int ncol)
+{
+    const int nc = (NCOL > 0)? NCOL: ncol;
+    int irow_dst = irow_low;
+    for(int irow_src = irow_low; irow_src >= 0; irow_src--)
+    {
+        if(board->isFull(irow_src))
+            continue;
+        if(irow_dst != irow_src)
+        {
+            memcpy(bin + irow_dst*nc, bin + irow_src*nc, nc);
+            board->moveRow(irow_src, irow_dst);
+        }
+        irow_dst--;
+    }
+    int n_cleared = irow_dst + 1;
+    for(; irow_dst >= 0; irow_dst--)
+    {
+        memset(bin + irow_dst*nc, 0, nc);
+        board->clearRow(irow_dst);
+    }
+    return n_cleared;
+}
+
+// ================================================================================= //
+// eval_and_clean
+//
+// it checks if there are full rows and remove them.
+// a full row is told by the bitboard in O(1), and the colors follow the same moves.
+// clearing k rows costs one pass over the rows, not k passes.
+// it returns the number of removed rows.
+// ================================================================================= //
+int ENGINE::eval_and_clean()
+{
+    // only the rows of the last piece can have become full.
+    // find the lowest full one among them.
+    int irow_low = -1;
+    int irow_top = (placed_p_y > 0)? placed_p_y: 0;
+    for(int irow = placed_p_y + NROW_PIECE - 1; irow >= irow_top; irow--)
+    {
+        if(irow < nrow && board->isFull(irow))
+        {
+            irow_low = irow;
+            break;
+        }
+    }
+    if(irow_low < 0)
+        return 0;
+
+    // compaction in a single pass from the lowest full row up.
+    // the default width and the common one have their own copies.
+    int n_cleared;
+    if(ncol == NCOL_BIN)
+        n_cleared = compact_rows<NCOL_BIN>(bin, board, irow_low, ncol);
+    else if(ncol == 10)
+        n_cleared = compact_rows<10>(bin, board, irow_low, ncol);
+    else
+        n_cleared = compact_rows<0>(bin, board, irow_low, ncol);
+
+    count_clearing_rows++;
+    count_by_rows[n_cleared]++;
+    return n_cleared;
+}
+
+// ================================================================================= //
+// getFallInterval
+//
+// It returns the interval between the falls at the current level in milliseconds.
+// ================================================================================= //
+int ENGINE::getFallInterval() const
+{
+    int interval = FALL_INTERVAL_MS;
+    for(int level = getLevel(); level > 0 && interval > FALL_INTERVAL_MIN_MS; level--)
+        interval = interval * 4 / 5;
+    return (interval > FALL_INTERVAL_MIN_MS)? interval: FALL_INTERVAL_MIN_MS;
+}
+
+// ================================================================================= //
+// isMovable
+//
+// it returns true if the current piece can move by the specified values.
+// otherwise, it returns false.
+//
+// the piece cannot move into the existing cells, the walls, and the floor.
+// the method does not care about the ceiling.
+// the test is done on the bitboard.
+// ================================================================================= //
+bool ENGINE::isMovable(int dx, int dy) const
+{
+    return !board->collides(PIECE_TABLE[cur_shape][cur_rot], cur_p_x + dx, cur_p_y + dy);
+}
+
+// ================================================================================= //
+// isRotatable
+//
+// It tells if the current piece can be rotated.
+// The argument indicates the rotation is clockwise or not.
+// The rotated piece is just the next entry of the rotation table.
+// ================================================================================= //
+bool ENGINE::isRotatable(bool clockwise) const
+{
+    int rot = clockwise? ROT_R(cur_rot): ROT_L(cur_rot);
+    return !board->collides(PIECE_TABLE[cur_shape][rot], cur_p_x, cur_p_y);
+}
+
+// ================================================================================= //
+// placePiece
+//
+// It places the current piece into the bin and the bitboard.
+// ================================================================================= //
+void ENGINE::placePiece()
+{
+    PIECE_MASK cur_mask = PIECE_TABLE[cur_shape][cur_rot];
+    for(int i = 0; i < NROW_PIECE; i++)
+    {
+        for(int j = 0; j < NCOL_PIECE; j++)
+        {
+            if(PIECE_CELL(cur_mask,i,j))
+                bin[(cur_p_y+i)*ncol + cur_p_x+j] = cur_color;
+        }
+    }
+    board->place(cur_mask, cur_p_x, cur_p_y);
+    placed_p_y = cur_p_y;
+    count_pieces++;
+}
@@ -0,0 +1,150 @@
+// engine.hpp
+//
+// The rules of the game without any drawing.
+// An ENGINE holds the whole state of one game, and the game advances only by step().
+// It never touches the terminal, so any number of engines can run side by side,
+// e.g., for batch simulations and tests. The terminal UI (GAME) is layered on top.
+//
+
+#ifndef _ENGINE_HPP
+#define _ENGINE_HPP
+
+#include <stdint.h>
+#include "board.hpp"
+#include "pieces.hpp"
+#include "rng.hpp"
+
+// the size of a cache line in bytes. the planes of the bin are aligned to it.
+#define CACHE_LINE 64
+
+// the limits of the size of the bin
+// (a row of the bitboard is 64 bits, and a replay keeps the size in a byte)
+#define MIN_NROW_BIN NROW_PIECE
+#define MAX_NROW_BIN 255
+#define MIN_NCOL_BIN NCOL_PIECE
+#define MAX_NCOL_BIN BOARD::MAX_NCOL
+
+// the speed of gravity: a level is CLEARINGS_PER_LEVEL clearings of rows.
+// the interval between the falls is FALL_INTERVAL_MS at the level 0,
+// and 4/5 of the one before at each level, but not less than FALL_INTERVAL_MIN_MS.
+#define CLEARINGS_PER_LEVEL 5
+#define FALL_INTERVAL_MS 500
+#define FALL_INTERVAL_MIN_MS 50
+
+// actions given to ENGINE::step
+enum ACTION
+{
+    ACT_NONE = 0,
+    ACT_LEFT,      // move the current piece to the left
+    ACT_RIGHT,     // move the current piece to the right
+    ACT_DOWN,      // move the current piece down
+    ACT_ROT_R,     // turn the current piece clockwise
+    ACT_ROT_L,     // turn the current piece anti-clockwise
+    ACT_GRAVITY,   // one fall step: fall, or place the piece and release the next one
+    N_ACTION
+};
+
+// events reported by ENGINE::step (bit flags)
+// moved: the current piece moved or turned
+#define EV_MOVED 1
+// locked: the current piece was placed in the bin, and the next piece came out
+#define EV_LOCKED 2
+// cleared: full rows were removed
+#define EV_CLEARED 4
+// over: the game is over
+#define EV_OVER 8
+
+class ENGINE
+{
+private:
+    // # of rows and # of columns of the bin
+    int nrow;
+    int ncol;
+
+    // bin: colors of the cells in row-major order (the cell (y, x) is at y*ncol + x)
+    uint8_t *bin;
+    // board: bitboard of the bin for the collision tests
+    BOARD *board;
+
+    // current piece: its shape, rotation, and color, and its location
+    // (the cells are looked up in PIECE_TABLE[cur_shape][cur_rot])
+    int cur_shape, cur_rot, cur_color;
+    int cur_p_x, cur_p_y;
+    // placed_p_y: the row where the last piece was placed
+    int placed_p_y;
+    // next piece: the piece which will be released
+    int next_shape, next_rot, next_color;
+
+    // the status of the game
+    // 0: over
+    // 1: running
+    int f_stat;
+
+    // counts of clearing full rows
+    int count_clearing_rows;
+    // statistics: # of placed pieces, and # of clearings by the number of rows removed at once
+    // (count_by_rows[k]: clearings which removed k rows)
+    int count_pieces;
+    int count_by_rows[NROW_PIECE+1];
+
+    // random number generator of this game, and its seed
+    // (every game started by init_stat begins from the seed)
+    RNG rng;
+    uint32_t rng_seed;
+    // 7-bag mode: the shapes are dealt from a shuffled bag of all seven,
+    // so every shape comes once in each run of seven pieces.
+    // bag_pos: the index of the next shape in the bag (N_SHAPE: the bag is empty)
+    bool f_bag;
+    uint8_t bag[N_SHAPE];
+    int bag_pos;
+
+    // an engine owns its planes, so it is not copied by accident
+    ENGINE(const ENGINE&);
+    ENGINE& operator=(const ENGINE&);
+
+public:
+    ENGINE(int nrow, int ncol, uint32_t seed);
+    ~ENGINE();
+
+    // it tells if a bin of the size can be played (see MIN_NROW_BIN etc.)
+    static bool isValidSize(int nrow, int ncol)
+    {
+        return MIN_NROW_BIN <= nrow && nrow <= MAX_NROW_BIN && MIN_NCOL_BIN <= ncol && ncol <= MAX_NCOL_BIN;
+    }
+
+    void seed(uint32_t seed);
+    void setBag(bool on);
+    void init_stat();
+    void load(const uint8_t *colors, int shape, int rot, int x, int y);
+    int step(ACTION act);
+    int isRunning() const;
+
+    // the rules behind step
+    void rand_next();
+    void copy_pieces();
+    bool isMovable(int dx, int dy) const;
+    bool isRotatable(bool clockwise) const;
+    void placePiece();
+    int eval_and_clean();
+
+    // the state
+    int getNRow() const { return nrow; }
+    int getNCol() const { return ncol; }
+    const uint8_t *getBin() const { return bin; }
+    int getCurShape() const { return cur_shape; }
+    int getCurRot() const { return cur_rot; }
+    int getCurColor() const { return cur_color; }
+    int getCurX() const { return cur_p_x; }
+    int getCurY() const { return cur_p_y; }
+    int getNextShape() const { return next_shape; }
+    int getNextRot() const { return next_rot; }
+    int getNextColor() const { return next_color; }
+    int getCountClearingRows() const { return count_clearing_rows; }
+    int getLevel() const { return count_clearing_rows / CLEARINGS_PER_LEVEL; }
+    int getFallInterval() const;
+    int getCountPieces() const { return count_pieces; }
+    int getCountByRows(int k) const { return count_by_rows[k]; }
+    const BOARD &getBoard() const { return *board; }
+};
+
+#endif //_ENGINE_HPP
@@ -2,7 +2,8 @@
 #define _FORMAT_MACRO_HPP
 
 #include <iostream>
-#include <sstream>
+#include "renderer.hpp"
+#include "dimension.hpp"
 using namespace std;
 
 // ====================================================================== //
@@ -53,54 +54,57 @@ using namespace std;
 // ====================================================================== //
 // Macros
 // ====================================================================== //
+// every macro draws into the frame buffer.
+// nothing appears on the terminal until FLUSH() is called.
+#define FRAME RENDERER::frame
+
 // === cursor on === //
-#define CURSOR_ON()  do{ cout << ESC << "[?25h"; }while(0)
+#define CURSOR_ON()  do{ FRAME << ESC << "[?25h"; }while(0)
 // === cursor off === //
-#define CURSOR_OFF() do{ cout << ESC << "[?25l"; }while(0)
+#define CURSOR_OFF() do{ FRAME << ESC << "[?25l"; }while(0)
 
 // === move the cursor to the given position === //
 // note: the position is specified by 1-index (it starts with 1, not 0)
-#define MOVE_CURSOR(x,y) \
-do{\
-    ostringstream sy; sy << (y);\
-    ostringstream sx; sx << (x);\
-    cout << ESC << "[" << sy.str() << ";" << sx.str() << "H";\
-}while(0)
+#define MOVE_CURSOR(x,y) do{ FRAME.move_cursor(x,y); }while(0)
 
-// === flush the output buffer === //
-#define FLUSH() do { cout << flush; }while(0)
+// === put a character n times at the current position === //
+#define PUT_CHARS(c,n) do{ FRAME.put_n(c,n); }while(0)
+
+// === send the frame to the terminal === //
+#define FLUSH() do { FRAME.flush(); }while(0)
 
 // === clear the screen === //
 #define CLEAR_SCREEN() \
-do{ cout << ESC << START_LOC << ESC << CLEAR; }while(0)
+do{ FRAME << ESC << START_LOC << ESC << CLEAR; }while(0)
 
 // === change the color of characters === //
-#define CHANGE_COLOR_DEF() do{ cout << ESC << CLR_DEF; }while(0)
-#define CHANGE_COLOR_BLACK() do{ cout << ESC << BLACK; }while(0)
-#define CHANGE_COLOR_BBLACK() do{ cout << ESC << BBLACK; }while(0)
-#define CHANGE_COLOR_WHITE() do{ cout << ESC << WHITE; }while(0)
-#define CHANGE_COLOR_BWHITE() do{ cout << ESC << BWHITE; }while(0)
-#define CHANGE_COLOR_RED() do{ cout << ESC << RED; }while(0)
-#define CHANGE_COLOR_BRED() do{ cout << ESC << BRED; }while(0)
-#define CHANGE_COLOR_GREEN() do{ cout << ESC << GREEN; }while(0)
-#define CHANGE_COLOR_BGREEN() do{ cout << ESC << BGREEN; }while(0)
-#define CHANGE_COLOR_BLUE() do{ cout << ESC << BLUE; }while(0)
-#define CHANGE_COLOR_BBLUE() do{ cout << ESC << BBLUE; }while(0)
-#define CHANGE_COLOR_YELLOW() do{ cout << ESC << YELLOW; }while(0)
-#define CHANGE_COLOR_BYELLOW() do{ cout << ESC << BYELLOW; }while(0)
-#define CHANGE_COLOR_MAGENTA() do{ cout << ESC << MAGENTA; }while(0)
-#define CHANGE_COLOR_BMAGENTA() do{ cout << ESC << BMAGENTA; }while(0)
-#define CHANGE_COLOR_CYAN() do{ cout << ESC << CYAN; }while(0)
-#define CHANGE_COLOR_BCYAN() do{ cout << ESC << BCYAN; }while(0)
+// the renderer remembers the current color and skips the redundant changes.
+// (see CHANGE_COLOR below for the color index)
+#define CHANGE_COLOR_DEF() do{ FRAME.set_color(0); }while(0)
+#define CHANGE_COLOR_BLACK() do{ FRAME.set_color(8); }while(0)
+#define CHANGE_COLOR_BBLACK() do{ FRAME.set_color(18); }while(0)
+#define CHANGE_COLOR_WHITE() do{ FRAME.set_color(7); }while(0)
+#define CHANGE_COLOR_BWHITE() do{ FRAME.set_color(17); }while(0)
+#define CHANGE_COLOR_RED() do{ FRAME.set_color(1); }while(0)
+#define CHANGE_COLOR_BRED() do{ FRAME.set_color(11); }while(0)
+#define CHANGE_COLOR_GREEN() do{ FRAME.set_color(2); }while(0)
+#define CHANGE_COLOR_BGREEN() do{ FRAME.set_color(12); }while(0)
+#define CHANGE_COLOR_BLUE() do{ FRAME.set_color(4); }while(0)
+#define CHANGE_COLOR_BBLUE() do{ FRAME.set_color(14); }while(0)
+#define CHANGE_COLOR_YELLOW() do{ FRAME.set_color(3); }while(0)
+#define CHANGE_COLOR_BYELLOW() do{ FRAME.set_color(13); }while(0)
+#define CHANGE_COLOR_MAGENTA() do{ FRAME.set_color(5); }while(0)
+#define CHANGE_COLOR_BMAGENTA() do{ FRAME.set_color(15); }while(0)
+#define CHANGE_COLOR_CYAN() do{ FRAME.set_color(6); }while(0)
+#define CHANGE_COLOR_BCYAN() do{ FRAME.set_color(16); }while(0)
 
 // === draw a horizontal line === //
+// the characters are contiguous, so the cursor is moved only once.
 #define DRAW_HLINE_C(y,x1,x2,c) \
 do{\
+    MOVE_CURSOR(x1,y);\
     for(int i_draw_hline = (x1); i_draw_hline <= (x2); i_draw_hline++)\
-    {\
-        MOVE_CURSOR(i_draw_hline,y);\
-        cout << c;\
-    }\
+        FRAME << c;\
 }while(0)
 #define DRAW_HLINE(y,x1,x2) DRAW_HLINE_C(y,x1,x2,'-')
 
@@ -110,22 +114,26 @@ do{\
     for(int i_draw_vline = (y1); i_draw_vline <= (y2); i_draw_vline++)\
     {\
         MOVE_CURSOR(x,i_draw_vline);\
-        cout << c;\
+        FRAME << c;\
     }\
 }while(0)
 #define DRAW_VLINE(x,y1,y2) DRAW_VLINE_C(x,y1,y2,'|')
 
 // === draw a rectangle === //
+// the top and bottom edges are drawn as one span including the corners.
+// note: it assumes x1 < x2 and y1 < y2
 #define DRAW_RECT_C(x1,y1,x2,y2,ch,cv,cc) \
 do{\
-    DRAW_HLINE_C(y1,x1,x2,ch);\
-    DRAW_HLINE_C(y2,x1,x2,ch);\
-    DRAW_VLINE_C(x1,y1,y2,cv);\
-    DRAW_VLINE_C(x2,y1,y2,cv);\
-    MOVE_CURSOR(x1,y1); cout << cc;\
-    MOVE_CURSOR(x1,y2); cout << cc;\
-    MOVE_CURSOR(x2,y1); cout << cc;\
-    MOVE_CURSOR(x2,y2); cout << cc;\
+    MOVE_CURSOR(x1,y1); FRAME << cc;\
+    for(int i_draw_rect = (x1)+1; i_draw_rect < (x2); i_draw_rect++)\
+        FRAME << ch;\
+    FRAME << cc;\
+    MOVE_CURSOR(x1,y2); FRAME << cc;\
+    for(int i_draw_rect = (x1)+1; i_draw_rect < (x2); i_draw_rect++)\
+        FRAME << ch;\
+    FRAME << cc;\
+    DRAW_VLINE_C(x1,(y1)+1,(y2)-1,cv);\
+    DRAW_VLINE_C(x2,(y1)+1,(y2)-1,cv);\
 }while(0)
 #define DRAW_RECT(x1,y1,x2,y2) DRAW_RECT_C(x1,y1,x2,y2,'-','|','+')
 
@@ -137,6 +145,57 @@ do{\
 }while(0)
 #define FILL_RECT(x1,y1,x2,y2) FILL_RECT_C(x1,y1,x2,y2,"▮")
 
+// === draw a span of n cells of the size w x h side by side === //
+// each line of the span is drawn with a single cursor movement.
+// every cell has the same look as the one drawn by FILL_RECT_C and DRAW_RECT_C.
+// note: it assumes w >= 2 and h >= 2
+#define DRAW_CELL_SPAN_C(x,y,w,h,n,ch,cv,cc,cf) \
+do{\
+    for(int j_cell_span = 0; j_cell_span < (h); j_cell_span++)\
+    {\
+        MOVE_CURSOR(x,(y)+j_cell_span);\
+        bool f_edge_cell_span = (j_cell_span == 0 || j_cell_span == (h)-1);\
+        for(int i_cell_span = 0; i_cell_span < (n); i_cell_span++)\
+        {\
+            if(f_edge_cell_span)\
+            {\
+                FRAME << cc;\
+                for(int k_cell_span = 2; k_cell_span < (w); k_cell_span++)\
+                    FRAME << ch;\
+                FRAME << cc;\
+            }\
+            else\
+            {\
+                FRAME << cv;\
+                for(int k_cell_span = 2; k_cell_span < (w); k_cell_span++)\
+                    FRAME << cf;\
+                FRAME << cv;\
+            }\
+        }\
+    }\
+}while(0)
+
+// === draw a span of n compact cells of the size w x 1 side by side === //
+// a cell is cl, (w-2) of cf and cr on a single line, e.g., "[]" for w = 2.
+// an empty span is just blanks.
+// note: it assumes w >= 2
+#define DRAW_CELL_SPAN_LINE_C(x,y,w,n,cl,cf,cr) \
+do{\
+    MOVE_CURSOR(x,y);\
+    for(int i_cell_line = 0; i_cell_line < (n); i_cell_line++)\
+    {\
+        FRAME << cl;\
+        for(int k_cell_line = 2; k_cell_line < (w); k_cell_line++)\
+            FRAME << cf;\
+        FRAME << cr;\
+    }\
+}while(0)
+#define DEL_CELL_SPAN_LINE(x,y,w,n) \
+do{\
+    MOVE_CURSOR(x,y);\
+    PUT_CHARS(' ',(w)*(n));\
+}while(0)
+
 // ====================================================================== //
 // Macros for cells
 // ====================================================================== //
@@ -149,10 +208,9 @@ do{\
 #define WCELL 4
 // height of a cell
 #define HCELL 3
-// nrow of the bin
-#define NROW_BIN 13
-// ncol of a piece
-#define NCOL_BIN 11
+// the size of a compact cell ("[]")
+#define WCELL_COMPACT 2
+#define HCELL_COMPACT 1
 
 // drawing lines based on cells in the bin
 #define DRAW_HLINE_C_CELL(cy,cx1,cx2,c) \
@@ -184,10 +242,11 @@ do{\
 #define WCELL_NBOX 4
 // height of a cell
 #define HCELL_NBOX 3
-// nrow of a piece
-#define NROW_PIECE 4
-// ncol of a piece
-#define NCOL_PIECE 4
+
+// === about the message box ===
+// the smallest size of the message box (the messages must fit in it)
+#define MESS_MIN_WIDTH 16
+#define MESS_MIN_HEIGHT 8
 
 // drawing lines based on cells in the next box
 #define DRAW_HLINE_C_CELL_NBOX(cy,cx1,cx2,c) \
@@ -219,48 +278,30 @@ do{\
 //   5: magenta   15: bright magenta
 //   6: cyan      16: bright cyan
 //   7: white     17: bright white
-#define CHANGE_COLOR(clr)\
-do{\
-    if(clr == 1)\
-        CHANGE_COLOR_RED();\
-    else if(clr == 2)\
-        CHANGE_COLOR_GREEN();\
-    else if(clr == 3)\
-        CHANGE_COLOR_YELLOW();\
-    else if(clr == 4)\
-        CHANGE_COLOR_BLUE();\
-    else if(clr == 5)\
-        CHANGE_COLOR_MAGENTA();\
-    else if(clr == 6)\
-        CHANGE_COLOR_CYAN();\
-    else if(clr == 7)\
-        CHANGE_COLOR_WHITE();\
-    else if(clr == 11)\
-        CHANGE_COLOR_BRED();\
-    else if(clr == 12)\
-        CHANGE_COLOR_BGREEN();\
-    else if(clr == 13)\
-        CHANGE_COLOR_BYELLOW();\
-    else if(clr == 14)\
-        CHANGE_COLOR_BBLUE();\
-    else if(clr == 15)\
-        CHANGE_COLOR_BMAGENTA();\
-    else if(clr == 16)\
-        CHANGE_COLOR_BCYAN();\
-    else if(clr == 17)\
-        CHANGE_COLOR_BWHITE();\
-    else\
-        CHANGE_COLOR_DEF();\
-}while(0)
+//   8: black     18: bright black
+// the mapping is a table lookup in the renderer.
+// the colors fit in a byte. CLR_UNKNOWN marks a cell whose color on the screen is unknown.
+#define CLR_UNKNOWN 0xFF
+#define CHANGE_COLOR(clr) do{ FRAME.set_color(clr); }while(0)
 
-// put a cell with specifying a color
-#define PUT_CELL_COLOR(cx,cy,clr)\
+// put a horizontal run of cells in the same color on a panel
+// whose top-left corner is (x0, y0), and whose cells are w x h characters.
+// (for the layouts computed at run time)
+// cells of a single line (h = 1) are drawn compact without the borders.
+#define PUT_CELL_SPAN_COLOR_AT(x0,y0,w,h,cx1,cx2,cy,clr)\
 do{\
     CHANGE_COLOR(clr);\
-    if(clr > 0)\
-        PUT_CELL(cx,cy);\
+    if((h) < 2)\
+    {\
+        if(clr > 0)\
+            DRAW_CELL_SPAN_LINE_C((x0)+(w)*(cx1),(y0)+(cy),w,(cx2)-(cx1)+1,'[','#',']');\
+        else\
+            DEL_CELL_SPAN_LINE((x0)+(w)*(cx1),(y0)+(cy),w,(cx2)-(cx1)+1);\
+    }\
+    else if(clr > 0)\
+        DRAW_CELL_SPAN_C((x0)+(w)*(cx1),(y0)+(h)*(cy),w,h,(cx2)-(cx1)+1,'-','|','+',"▮");\
     else\
-        DEL_CELL(cx,cy);\
+        DRAW_CELL_SPAN_C((x0)+(w)*(cx1),(y0)+(h)*(cy),w,h,(cx2)-(cx1)+1,' ',' ',' ',' ');\
 }while(0)
 
 #endif //_FORMAT_MACRO_HPP
@@ -1,7 +1,8 @@
 // game_core.cpp
 //
 // This file contains the core of the game program.
-// It maintains updates of the state and displaying the results based on the given character input.
+// It drives the engine (engine.hpp), which holds the state and the rules,
+// and displays the results based on the given key input.
 //
 // The object of the GAME class must be singleton, so its constructor/destructor are not public.
 // To start a game, it is required to call the init_game method.
@@ -14,119 +15,181 @@
 #include <iostream>
 #include <iomanip>
 
-#include <thread>
-#include <mutex>
-
-#include <unistd.h> // usleep
-#include <stdlib.h> // random number gen
-#include <time.h> // random number gen
+#include <unistd.h> // read, write
+#include <sys/ioctl.h> // TIOCGWINSZ
+#include <poll.h>
+#include <sys/timerfd.h>
+#include <sys/eventfd.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h> // getenv
+#include <string.h> // memcpy, memset
+#include <time.h> // time, clock_gettime
 
 using namespace std;
 
+// ================================================================================= //
+// monotonic_ns
+//
+// the monotonic clock in nanoseconds
+// ================================================================================= //
+static uint64_t monotonic_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
 // ================================================================================= //
 // the pointer to the object is initialized with NULL.
 // so the program can tell if there is an existing one.
 // ================================================================================= //
 GAME* GAME::game = NULL;
+volatile sig_atomic_t GAME::f_resized = 0;
+int GAME::signal_fd = -1;
+
 
 // ================================================================================= //
 // Constructor
 //
 // It cleans up the screen for setup.
-// It also initializes the graphical parameters for the game.
-// Then, it initializes the random number generator.
+// Then, it initializes the random number generator, the engine of the game, and its view.
+// If a replay is given, the engine is seeded from it, and deals the pieces in the same way
+// (7-bag or not). Otherwise, from the clock.
 // Then, it initializes the internal parameters.
 // Then, it draws the background including boxes and cells.
-// Finally, it prepares a thread to independently run the update function.
+// Finally, it prepares the gravity timer and the frame timer,
+// and starts the game loop in another thread.
+// While replaying, the timer is used to wait for the recorded actions instead of gravity.
 //
 // ================================================================================= //
-GAME::GAME()
+GAME::GAME(const GAME_OPTION &opt)
 {
     CLEAR_SCREEN();
     CURSOR_OFF();
 
-    nrow = NROW_BIN;
-    ncol = NCOL_BIN;
+    nrow = opt.nrow;
+    ncol = opt.ncol;
 
-    bin_start_x = START_CELL_X;
-    bin_start_y = START_CELL_Y;
-
-    next_start_x = START_CELL_NBOX_X;
-    next_start_y = START_CELL_NBOX_Y;
-    next_width = 4*WCELL;
-    next_height = 4*HCELL;
-
-    screen_width = next_start_x + next_width + 1;
-    screen_height = bin_start_y + nrow * HCELL + 3;
-
-    mess_start_x = START_CELL_NBOX_X;
-    mess_start_y = START_CELL_NBOX_Y + next_height + 1 + 1;
-    mess_width = next_width;
-    mess_height = bin_start_y + nrow*HCELL - mess_start_y;
-
-    bin = new int*[nrow];
-    canvas = new int*[nrow];
-    shadow = new int*[nrow];
-    for(int i = 0; i < nrow; i++)
+    uint32_t seed = time(NULL);
+    bool f_bag = false;
+    f_replay = false;
+    rep_pending = false;
+    if(opt.replay_path != NULL && player.open(opt.replay_path)
+        && player.getHeader().nrow == nrow && player.getHeader().ncol == ncol)
     {
-        bin[i] = new int[ncol];
-        canvas[i] = new int[ncol];
-        shadow[i] = new int[ncol];
+        f_replay = true;
+        seed = player.getHeader().seed;
+        f_bag = (player.getHeader().flags & REPLAY_F_BAG) != 0;
+        rep_pending = player.next(rep_act, rep_t);
+    }
+    engine = new ENGINE(nrow, ncol, seed);
+    engine->setBag(f_bag);
+    view = new VIEW(engine, opt.wcell, opt.hcell);
+    if(opt.record_path != NULL)
+    {
+        REPLAY_HEADER header;
+        header.nrow = nrow;
+        header.ncol = ncol;
+        header.flags = f_bag? REPLAY_F_BAG: 0;
+        header.seed = seed;
+        recorder.open(opt.record_path, header);
     }
-
-    srand(time(NULL));
 
     init_stat();
-    
-    draw_background();
-    draw_cells();
+
+    struct winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == 0)
+        view->fit(ws.ws_col, ws.ws_row);
+    view->draw_background();
+    view->draw_cells();
     FLUSH();
 
-    n_step = 100;
-    i_step = 0;
-    t_update = thread(&GAME::update,this);
+    // the gravity timer is armed for the next fall on the monotonic clock
+    fall_interval = engine->getFallInterval();
+    timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    clock_gettime(CLOCK_MONOTONIC, &t_start);
+    t_fall_tick = monotonic_ns();
+    fall_acc = 0;
+    if(f_replay)
+    {
+        set_timer_at(rep_pending? rep_t: 0);
+    }
+    else
+    {
+        set_gravity_timer();
+    }
+
+    // 60 frames per second at most
+    frame_interval = 1000000000ULL / 60;
+    frame_fd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    t_last_frame = 0;
+    f_frame_pending = false;
+
+    wake_fd = eventfd(0, EFD_CLOEXEC);
+    f_quit = false;
+    done_fd = eventfd(0, EFD_CLOEXEC);
+    f_quitting = false;
+
+    // a resize is only noted by the handler. the game loop redraws the screen.
+    f_resized = 0;
+    signal_fd = wake_fd;
+    struct sigaction sa;
+    memset(&sa, 0, sizeof(sa));
+    sa.sa_handler = on_winch;
+    sigemptyset(&sa.sa_mask);
+    sa.sa_flags = SA_RESTART;
+    sigaction(SIGWINCH, &sa, &old_winch);
+#ifdef WASTEDRIS_PROF
+    f_overlay = false;
+    t_overlay = 0;
+#endif
+    t_update = thread(&GAME::run,this);
 }
 
 // ================================================================================= //
 // Destructor
 //
-// If the game is not over, the method tells it to stop, and plays the end movie.
-// Then, the main thread waits for the update thread to join.
+// It tells the game loop to finish, and waits for the thread to join.
+// If the game is still running or ending at that time, the loop just stops.
 // Then, it releases the heap memory.
 // Finally, it displays a message.
 // ================================================================================= //
 GAME::~GAME()
 {
-    if(f_stat != 0)
-    {
-        mtx.lock();
-        f_stat = 0;
-        mtx.unlock();
-    }
+    f_quit = true;
+    uint64_t one = 1;
+    // the eventfd cannot be full, and there is nothing to do if the write fails
+    ssize_t r = write(wake_fd, &one, sizeof(one));
+    (void)r;
     t_update.join();
-    if(bin != NULL)
-    {
-        for(int i = 0; i < nrow; i++)
-            delete[] bin[i];
-        delete[] bin;
-    }
-    if(canvas != NULL)
-    {
-        for(int i = 0; i < nrow; i++)
-            delete[] canvas[i];
-        delete[] canvas;
-    }
-    if(shadow != NULL)
-    {
-        for(int i = 0; i < nrow; i++)
-            delete[] shadow[i];
-        delete[] shadow;
-    }
+    sigaction(SIGWINCH, &old_winch, NULL);
+    signal_fd = -1;
+#ifdef WASTEDRIS_PROF
+    // the stats go to $WASTEDRIS_PROF_FILE (or wastedris.prof)
+    const char *prof_path = getenv("WASTEDRIS_PROF_FILE");
+    FILE *fp = fopen((prof_path != NULL)? prof_path: "wastedris.prof", "w");
+    if(fp != NULL)
+    {
+        PROF::stats.dump(fp);
+        fclose(fp);
+    }
+#endif
+    recorder.close();
+    player.close();
+    close(wake_fd);
+    close(done_fd);
+    close(timer_fd);
+    close(frame_fd);
+    delete view;
+    delete engine;
 
+    CHANGE_COLOR_DEF();
     CLEAR_SCREEN();
     CURSOR_ON();
     MOVE_CURSOR(1,1);
-    cout << endl << "           go back to work now" << endl << endl;
+    FRAME << "\n           go back to work now\n\n";
+    FLUSH();
 }
 
 // ================================================================================= //
@@ -135,54 +198,17 @@ GAME::~GAME()
 // This function initializes the state of the game, and restarts the thread.
 // 
 // ================================================================================= //
-GAME *GAME::init_game()
+GAME *GAME::init_game(const GAME_OPTION &opt)
 {
     if(game != NULL)
     {
         delete game;
     }
-    game = new GAME();
+    game = new GAME(opt);
 
     return game;
 }
 
-// ================================================================================= //
-// end_movie
-//
-// This plays the end movie.
-// ================================================================================= //
-void GAME::play_endmovie()
-{
-    int width = screen_width;
-    int height = screen_height;
-
-    CHANGE_COLOR_BRED();
-    char symbols[5] = {' ', '.', ';', '*', '#'};
-    int thresholds[5] = {0, 90, 30, 5, 0};
-    for(int i = height; i >= 1; i--)
-    {
-        for(int isym = 0; isym < 5; isym++)
-        {
-            if(i - isym >= 1)
-            {
-                DRAW_HLINE_C(i - isym, 1, 1, string(width, symbols[isym]));
-                for(int icol = 1; icol <= width && thresholds[isym] != 0; icol++)
-                {
-                    int rand_v = rand()%100;
-                    if(rand_v < thresholds[isym])
-                    {
-                        MOVE_CURSOR(icol,i-isym);
-                        cout << ' ';
-                    }
-                }
-            }
-        }
-        FLUSH();
-        usleep(60000);
-    }
-    CHANGE_COLOR_DEF();
-}
-
 // ================================================================================= //
 // kill_game
 // This function stops the running game and kills the thread.
@@ -201,187 +227,106 @@ void GAME::kill_game()
 // ================================================================================= //
 // init_stat
 //
-// initializes all internal parameters.
-// also it clears the message box.
+// initializes all internal parameters including the engine and the view.
 // ================================================================================= //
 void GAME::init_stat()
 {
-    for(int i = 0; i < nrow; i++)
-    {
-        for(int j =0; j < ncol; j++)
-        {
-            bin[i][j] = 0;
-            canvas[i][j] = 0;
-            shadow[i][j] = 0;
-        }
-    }
-    for(int i = 0; i < NROW_PIECE; i++)
-    {
-        for(int j = 0; j < NCOL_PIECE; j++)
-        {
-            cur_piece[i][j] = 0;
-            next_piece[i][j] = 0;
-        }
-    }
+    engine->init_stat();
 
-    count_clearing_rows = 0;
     f_stat = 1;
-    rand_next();
-    copy_pieces();
-    rand_next();
 
-    clear_message();
+    view->reset();
 }
 
 // ================================================================================= //
 // abort()
 //
 // This aborts the game and plays the end movie.
+// When the movie is over, the program ends.
 // ================================================================================= //
 void GAME::abort()
 {
-    f_stat = 0;
-    play_endmovie();
+    start_ending(true);
 }
 
 // ================================================================================= //
-// rand_next()
+// start_ending
 //
-// It generates a randomized piece in the next box.
-// It first generates a square shape. Then, it randomly changes the shape.
-// After all, each shape appears at a chance of 1/7.
-// Finally, it turns the generated piece randomly.
-//
-// *This method assumes the size of the piece is 4x4.
-// 
+// It stops the game and starts the end movie.
+// The gravity timer is turned to the pace of the movie, and each expiration
+// draws and sends one frame of it (see step_ending). So the game loop keeps
+// handling keys and the quit while the movie is playing.
 // ================================================================================= //
-void GAME::rand_next()
+void GAME::start_ending(bool quitting)
 {
-    int color = rand()%12;
-    if(color < 6) color++;
-    else color += 5;
-
-    next_piece[0][0] = 0; next_piece[0][1] = 0; next_piece[0][2] = 0; next_piece[0][3] = 0;
-    next_piece[1][0] = 0; next_piece[1][1] = color; next_piece[1][2] = color; next_piece[1][3] = 0;
-    next_piece[2][0] = 0; next_piece[2][1] = color; next_piece[2][2] = color; next_piece[2][3] = 0;
-    next_piece[3][0] = 0; next_piece[3][1] = 0; next_piece[3][2] = 0; next_piece[3][3] = 0;
-
-    double p_val = (double)rand()/RAND_MAX;
-    if(p_val < 3.0/7.0)
-    {
-        next_piece[1][1] = 0;
-        next_piece[0][2] = color;
-        p_val = (double)rand()/RAND_MAX;
-        if(p_val < 1.0/6.0)
-        {
-            next_piece[2][1] = 0;
-            next_piece[3][2] = color;
-        }
-        else if(p_val < 2.0/6.0)
-        {
-            next_piece[1][1] = color;
-            next_piece[2][1] = 0;
-        }
-        else if(p_val < 2.0/3.0)
-        {
-            next_piece[0][2] = 0;
-            next_piece[1][3] = color;
-        }
-    }
-    else if(p_val < 6.0/7.0)
-    {
-        next_piece[2][1] = 0;
-        next_piece[3][2] = color;
-        p_val = (double)rand()/RAND_MAX;
-        if(p_val < 1.0/6.0)
-        {
-            next_piece[1][1] = 0;
-            next_piece[0][2] = color;
-        }
-        else if(p_val < 2.0/6.0)
-        {
-            next_piece[1][1] = 0;
-            next_piece[2][1] = color;
-        }
-        else if(p_val < 2.0/3.0)
-        {
-            next_piece[3][2] = 0;
-            next_piece[2][3] = color;
-        }
-    }
-
-    p_val = (double)rand()/RAND_MAX;
-    if(p_val < 1.0/4.0)
-        rotL_piece(next_piece);
-    else if(p_val < 2.0/4.0)
-        rotR_piece(next_piece);
-    else if(p_val < 3.0/4.0)
-    {
-        rotL_piece(next_piece);
-        rotL_piece(next_piece);
-    }
+    f_stat = 2;
+    f_quitting = quitting;
+
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(frame_fd, 0, &its, NULL);
+    f_frame_pending = false;
+    its.it_interval.tv_sec = ENDMOVIE_INTERVAL / 1000;
+    its.it_interval.tv_nsec = (ENDMOVIE_INTERVAL % 1000) * 1000000L;
+    its.it_value = its.it_interval;
+    timerfd_settime(timer_fd, 0, &its, NULL);
+
+    view->start_endmovie();
 }
 
 // ================================================================================= //
-// copy_pieces()
+// step_ending
 //
-// It copies a piece in the next box to the current box.
-// Then, it initializes the curr piece's location.
+// It shows the next frame of the end movie, or finishes it if it is over.
 // ================================================================================= //
-void GAME::copy_pieces()
+void GAME::step_ending()
 {
-    for(int i = 0; i < NROW_PIECE; i++)
-    {
-        for(int j = 0; j < NCOL_PIECE; j++)
-        {
-            cur_piece[i][j] = next_piece[i][j];
-        }
-    }
-    cur_p_x = (ncol - NCOL_PIECE)/2;
-    cur_p_y = -1*NROW_PIECE;
+    if(view->draw_endmovie())
+        FLUSH();
+    else
+        finish_ending();
 }
 
 // ================================================================================= //
-// rotR_piece
+// finish_ending
 //
-// This rotates a piece clockwise.
+// It shows the end of the movie at once, and stops the game.
+// If the game is over, the user is asked for a key before the program ends.
+// If the user has quit, the main thread is told that the program can end.
 // ================================================================================= //
-void GAME::rotR_piece(int (*piece)[NCOL_PIECE])
+void GAME::finish_ending()
 {
-    int buff[NROW_PIECE][NCOL_PIECE];
-
-    for(int i = 0; i < NROW_PIECE; i++)
-        for(int j = 0; j < NCOL_PIECE; j++)
-            buff[j][NCOL_PIECE-1-i] = piece[i][j];
-    for(int i = 0; i < NROW_PIECE; i++)
-        for(int j = 0; j < NCOL_PIECE; j++)
-            piece[i][j] = buff[i][j];
-}
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    timerfd_settime(timer_fd, 0, &its, NULL);
 
-// ================================================================================= //
-// rotL_piece
-//
-// This rotates a piece anti-clockwise.
-// ================================================================================= //
-void GAME::rotL_piece(int (*piece)[NCOL_PIECE])
-{
-    int buff[NROW_PIECE][NCOL_PIECE];
-
-    for(int i = 0; i < NROW_PIECE; i++)
-        for(int j = 0; j < NCOL_PIECE; j++)
-            buff[NROW_PIECE-1-j][i] = piece[i][j];
-    for(int i = 0; i < NROW_PIECE; i++)
-        for(int j = 0; j < NCOL_PIECE; j++)
-            piece[i][j] = buff[i][j];
+    view->finish_endmovie();
+    if(!f_quitting)
+    {
+        MOVE_CURSOR(1,1);
+        FRAME << "press any button.\n";
+    }
+    FLUSH();
+    f_stat = 0;
+    if(f_quitting)
+    {
+        uint64_t one = 1;
+        // if it fails, the main thread still ends with the next key
+        ssize_t r = write(done_fd, &one, sizeof(one));
+        (void)r;
+    }
 }
 
 // ================================================================================= //
 // play_game
 //
-// This function updates the state of the game based on the given character.
+// This function gives a key to the game.
+// The key is pushed to the input queue, and the game loop handles it.
+// It never waits for the game loop, even while the screen is being drawn.
+// If the queue is full, the key is dropped.
 //
 // input:
-//   char c: a character provided by the user
+//   KEY key: a key typed by the user
 // output:
 //   the state to continue the game
 //       1: running
@@ -389,378 +334,454 @@ void GAME::rotL_piece(int (*piece)[NCOL_PIECE])
 //       others: error or the game is not running correctly
 //       
 // ================================================================================= //
-int GAME::play_game(char c)
+int GAME::play_game(KEY key)
 {
-    mtx.lock();
-
-    if(c == '\x04')
-    {
-        abort();
-    }
-    else if(c == 'C') // right arrow 
-    {
-        if(isMovable(1,0))
-            cur_p_x++;
-    }
-    else if(c == 'D') // left arrow
-    {
-        if(isMovable(-1,0))
-            cur_p_x--;
-    }
-    else if(c == 'B') // down arrow
-    {
-        if(isMovable(0,1))
-            cur_p_y++;
-    }
-    else if(c == ' ' || c == 'x') // for clockwise rotation
-    {
-        if(isRotatable(true))
-            rotR_piece(cur_piece);
-    }
-    else if(c == 'z') // for anti-clockwise rotation
-    {
-        if(isRotatable(false))
-            rotL_piece(cur_piece);
-    }
-    draw_cells();
-
-    mtx.unlock();
-
-    return f_stat;
+    return play_keys(&key, 1);
 }
 
 // ================================================================================= //
-// draw_background
+// play_keys
 //
-// This method draws the background including the bin and the next box.
+// This function gives the keys decoded from one read to the game.
+// All of them are pushed to the input queue before the game loop is woken up once,
+// so a burst of keys costs a single write to the eventfd.
+// Keys that do not fit in the queue are dropped.
 //
+// input:
+//   const KEY *keys: keys typed by the user
+//   int n_keys: the number of the keys
+// output:
+//   the same as play_game
+//       
 // ================================================================================= //
-void GAME::draw_background()
+int GAME::play_keys(const KEY *keys, int n_keys)
 {
-    CLEAR_SCREEN();
-    CHANGE_COLOR_CYAN();
-    DRAW_RECT(bin_start_x-1, bin_start_y-1, bin_start_x+WCELL*ncol, bin_start_y+HCELL*nrow);
-    DRAW_RECT(next_start_x-1, next_start_y-1, next_start_x+next_width, next_start_y+next_height);
-    MOVE_CURSOR(next_start_x+WCELL*2-2, next_start_y-1);
-    cout << "NEXT";
-    DRAW_RECT(mess_start_x-1, mess_start_y-1, mess_start_x+mess_width, mess_start_y+mess_height);
-    CHANGE_COLOR_DEF();
-    FLUSH();
+    int n_pushed = 0;
+    for(int i = 0; i < n_keys; i++)
+    {
+#ifdef WASTEDRIS_PROF
+        uint64_t t_push = PROF_NOW();
+#endif
+        if(!input_queue.push(keys[i]))
+            break;
+#ifdef WASTEDRIS_PROF
+        input_time_queue.push(t_push);
+#endif
+        n_pushed++;
+    }
+    if(n_pushed > 0)
+    {
+        uint64_t one = 1;
+        if(write(wake_fd, &one, sizeof(one)) < 0)
+            return -1;
+    }
+
+    return f_stat;
 }
 
 // ================================================================================= //
-// draw_cells
-//
-// It draws all cells in the bin and the next box.
-//
-// For the bin, it remembers which color is stored for each cell.
-// Only if a cell is to be changed in color, it draws the cell.
+// handle_input
 //
-// To draw the bin, it first generates a table of color information for each cell.
-// Then, the table is compared with the old one.
-// Only if different, the cell is redrawn.
+// This function converts the given key into an action of the engine.
+// It only marks what has changed. The game loop draws them after all keys at hand.
+// It is called only in the game loop.
+// While replaying, only Ctrl-D is taken from the user.
+// In a build with the instrumentation, 'p' shows or hides the stats in the message box.
 //
-// color index:
-//   1: red       11: bright red
-//   2: green     12: bright green 
-//   3: yellow    13: bright yellow
-//   4: blue      14: bright blue
-//   5: magenta   15: bright magenta
-//   6: cyan      16: bright cyan
-//   7: white     17: bright white
+// input:
+//   KEY key: a key typed by the user
+//       
 // ================================================================================= //
-void GAME::draw_cells()
+void GAME::handle_input(KEY key)
 {
-    for(int i = 0; i < ncol; i++)
-    {
-        for(int j = 0; j < nrow; j++)
-        {
-            if(bin[j][i]==0)
-            {
-                canvas[j][i] = 0;
-            }
-            else
-            {
-                canvas[j][i] = bin[j][i];
-            }
-        }
-    }
-    for(int i = 0; i < NCOL_PIECE; i++)
+    // any key skips the end movie (Ctrl-D also ends the program after it)
+    if(isEnding())
     {
-        for(int j = 0; j < NROW_PIECE; j++)
-        {
-            if(cur_piece[j][i]>0)
-            {
-                if(0<=cur_p_x+i&&cur_p_x+i<ncol&&0<=cur_p_y+j&&cur_p_y+j<nrow)
-                    canvas[cur_p_y+j][cur_p_x+i] = cur_piece[j][i];
-            }
-        }
+        if(key == KEY_QUIT)
+            f_quitting = true;
+        finish_ending();
+        return;
     }
-    CHANGE_COLOR_GREEN();
-    for(int i = 0; i < ncol; i++)
+    if(key == KEY_QUIT)
     {
-        for(int j = 0; j < nrow; j++)
-        {
-            if(canvas[j][i] != shadow[j][i])
-            {
-                PUT_CELL_COLOR(i,j,canvas[j][i]);
-                shadow[j][i] = canvas[j][i];
-            }
-        }
+        abort();
+        return;
     }
-    for(int i = 0; i < NCOL_PIECE; i++)
+#ifdef WASTEDRIS_PROF
+    if(key == KEY_STATS)
     {
-        for(int j = 0; j < NROW_PIECE; j++)
-        {
-            if(next_piece[j][i]==0)
-            {
-                DEL_CELL_NBOX(i,j);
-            }
-            else
-            {
-                CHANGE_COLOR(next_piece[j][i]);
-                PUT_CELL_NBOX(i,j);
-            }
-        }
-    }
-    CHANGE_COLOR_DEF();
-    FLUSH();
+        f_overlay = !f_overlay;
+        if(f_overlay)
+            t_overlay = 0;
+        else
+            view->refresh_message();
+        return;
+    }
+#endif
+    if(f_replay)
+        return;
+
+    ACTION act = ACT_NONE;
+    if(key == KEY_RIGHT)
+        act = ACT_RIGHT;
+    else if(key == KEY_LEFT)
+        act = ACT_LEFT;
+    else if(key == KEY_DOWN)
+        act = ACT_DOWN;
+    else if(key == KEY_ROT_R) // for clockwise rotation
+        act = ACT_ROT_R;
+    else if(key == KEY_ROT_L) // for anti-clockwise rotation
+        act = ACT_ROT_L;
+    if(act != ACT_NONE)
+        recorder.record(act, elapsed_ms());
+    view->mark_dirty(engine->step(act));
 }
 
 // ================================================================================= //
-// put_message()
+// on_winch
 //
-// put a message in the message box
+// The handler of SIGWINCH. It only notes the resize and wakes up the game loop,
+// since nothing else is safe in a signal handler.
 // ================================================================================= //
-void GAME::put_message()
+void GAME::on_winch(int sig)
 {
-    CHANGE_COLOR_MAGENTA();
-    if(count_clearing_rows == 1)
-    {
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+1);
-        cout << "YOU WASTED";
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+2);
-        cout << "YOUR TIME";
-    }
-    else if(count_clearing_rows == 2)
+    (void)sig;
+    int saved_errno = errno;
+    f_resized = 1;
+    uint64_t one = 1;
+    // if the game loop cannot be woken up, the resize is handled with the next key
+    if(signal_fd >= 0)
     {
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+3);
-        cout << "AGAIN";
+        ssize_t r = write(signal_fd, &one, sizeof(one));
+        (void)r;
     }
-    else if(count_clearing_rows > 2)
-    {
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+3);
-        cout << count_clearing_rows << " TIMES";
-    }
-    if(count_clearing_rows > 10)
-    {
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+5);
-        cout << "It's time";
-        MOVE_CURSOR(mess_start_x+1,mess_start_y+6);
-        cout << "to regret";
-    }
-    CHANGE_COLOR_DEF();
-    FLUSH();
+    errno = saved_errno;
 }
 
 // ================================================================================= //
-// clear_message
+// resize
 //
-// It clears everything in the message box
+// It lays out the screen for the new size of the terminal.
+// If the layout has changed, the screen is cleared and drawn from scratch.
+// Otherwise, only the frames of the boxes are drawn over the screen as it is,
+// and the panels are marked as unknown, so the next frame redraws all cells once.
+// It is called only in the game loop.
 // ================================================================================= //
-void GAME::clear_message()
+void GAME::resize()
 {
-    for(int y = mess_start_y; y < mess_start_y + mess_height; y++)
-    {
-        MOVE_CURSOR(mess_start_x,y);
-        cout << string(mess_width,' ');
-    }
+    struct winsize ws;
+    if(ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) != 0)
+        return;
+    if(view->fit(ws.ws_col, ws.ws_row))
+        view->draw_background();
+    else
+    {
+        view->draw_boxes();
+        view->invalidate(false);
+    }
+#ifdef WASTEDRIS_PROF
+    t_overlay = 0;
+#endif
 }
 
 // ================================================================================= //
 // update
 //
-// This method takes one step to update the game status controlling mutex.
+// This method takes one step to update the game status.
+// It is called for every fall due on the gravity clock (see tick_gravity),
+// and for every recorded fall while replaying.
 //
-// It checks if the current piece can fall by one cell.
-// If so, just let it go.
-// Otherwise, it checks if the current piece is off the area of the bin.
-// If so, the game is over.
-// Otherwise, it places the current piece in the bin, and evaluates the game.
+// The engine lets the current piece fall, or places it and releases the next one.
+// If the engine tells the game is over, it shows the message and starts the end movie.
+// Otherwise, the changes are shown in the next frame.
 // 
 // ================================================================================= //
 void GAME::update()
 {
-    while(isRunning())
-    {
-        
-        mtx.lock();
-        if(i_step == 0)
-        {
-            if(isMovable(0,1))
-            {
-                cur_p_y++; 
-                draw_cells();
-            }
-            else if(cur_p_y < 0)
-            {
-                f_stat = 0;
-                CHANGE_COLOR_BRED();
-                MOVE_CURSOR(screen_width/2-6,screen_height/2-2);
-                cout << "#############";
-                MOVE_CURSOR(screen_width/2-6,screen_height/2-1);
-                cout << "#           #";
-                MOVE_CURSOR(screen_width/2-6,screen_height/2);
-                cout << "# GAME OVER #";
-                MOVE_CURSOR(screen_width/2-6,screen_height/2+1);
-                cout << "#           #";
-                MOVE_CURSOR(screen_width/2-6,screen_height/2+2);
-                cout << "#############";
-                MOVE_CURSOR(screen_width/2-4,screen_height/2);
-                CHANGE_COLOR_DEF();
-                play_endmovie();
-                MOVE_CURSOR(1,1);
-                cout << "press any button." << endl;
-            }
-            else
-            {
-                placePiece();
-                copy_pieces();
-                rand_next();
-                eval_and_clean();
-            }
-            put_message();
-        }
+    recorder.record(ACT_GRAVITY, elapsed_ms());
+    int events = engine->step(ACT_GRAVITY);
+    view->mark_dirty(events);
+    if(events & EV_OVER)
+    {
+        // the frame deferred by present() is shown first, since the ending cancels it
+        draw_frame();
+        view->draw_game_over();
         FLUSH();
-        i_step = (i_step + 1) % n_step;
-        mtx.unlock();
-
-        usleep(5000);
+        start_ending(false);
+    }
+    else
+    {
+        present();
     }
-    FLUSH();
 }
 
 // ================================================================================= //
-// eval_and_clean
+// tick_gravity
 //
-// it checks if there are full rows and remove them.
+// It is called when the gravity timer expires.
+// The time since the last tick is added to the accumulator, and the piece falls
+// once for every fall_interval in it. The rest is kept for the next tick,
+// and the timer is armed for when it makes up a whole interval.
+// So the falls keep the same pace however late the loop wakes up.
+// After a long stall (e.g., the process was stopped), the piece falls
+// MAX_FALLS_PER_TICK times at most, and the rest of the time is dropped.
+// The interval follows the level, which may go up by the falls.
 // ================================================================================= //
-void GAME::eval_and_clean()
+void GAME::tick_gravity()
 {
-    bool f_cleared_at_least_one = false;
-    for(int irow_search = nrow-1; irow_search >= 0;)
+    uint64_t now = monotonic_ns();
+    fall_acc += now - t_fall_tick;
+    t_fall_tick = now;
+
+    int n_falls = 0;
+    while(isRunning() && fall_acc >= (uint64_t)fall_interval*1000000ULL)
     {
-        bool f_full = true;
-        for(int icol = 0; icol < ncol; icol++)
-            if(bin[irow_search][icol]==0)
-                f_full = false;
-        if(f_full)
+        if(n_falls == MAX_FALLS_PER_TICK)
         {
-            for(int irow_clean = irow_search; irow_clean > 0; irow_clean--)
-            {
-                for(int icol = 0; icol < ncol; icol++)
-                    bin[irow_clean][icol] = bin[irow_clean-1][icol];
-            }
-            f_cleared_at_least_one = true;
-        }
-        else
-        {
-            irow_search --;
+            fall_acc = 0;
+            break;
         }
+        fall_acc -= (uint64_t)fall_interval*1000000ULL;
+        update();
+        fall_interval = engine->getFallInterval();
+        n_falls++;
     }
-    if(f_cleared_at_least_one)
-        count_clearing_rows++;
+    if(isRunning())
+        set_gravity_timer();
 }
 
 // ================================================================================= //
-// isMovable
+// set_gravity_timer
 //
-// it returns true if the current piece can move by the specified values.
-// otherwise, it returns false.
+// It arms the gravity timer to expire once, when the accumulator makes up fall_interval.
+// ================================================================================= //
+void GAME::set_gravity_timer()
+{
+    uint64_t t_due = t_fall_tick + (uint64_t)fall_interval*1000000ULL - fall_acc;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = t_due / 1000000000ULL;
+    its.it_value.tv_nsec = t_due % 1000000000ULL;
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+// ================================================================================= //
+// present
 //
-// the piece cannot move into the existing cells, the walls, and the floor.
-// the method does not care about the ceiling.
+// It shows the changes marked so far.
+// If the last frame was sent less than frame_interval ago, the frame is deferred
+// until the frame timer expires, and the changes until then are drawn together.
+// So a burst of keys (e.g., auto-repeat) costs one frame per display refresh at most.
 // ================================================================================= //
-bool GAME::isMovable(int dx, int dy)
+void GAME::present()
 {
-    int proposed_x = cur_p_x + dx;
-    int proposed_y = cur_p_y + dy;
-    bool f_movable = true;
+    if(f_frame_pending)
+        return;
 
-    for(int i = 0; i < NROW_PIECE; i++)
+    uint64_t now = monotonic_ns();
+    if(now - t_last_frame >= frame_interval)
     {
-        for(int j = 0; j < NCOL_PIECE; j++)
-        {
-            int x = proposed_x+j;
-            int y = proposed_y+i;
-            if(cur_piece[i][j]!=0)
-            {
-                if(0<=x && x<ncol && 0<=y && y<nrow && bin[y][x]!=0)
-                    f_movable = false;
-                if(x < 0 || ncol <= x || nrow <= y)
-                    f_movable = false;
-            }
-        }
+        draw_frame();
+        t_last_frame = now;
+        return;
     }
 
-    return f_movable;
+    uint64_t wait = t_last_frame + frame_interval - now;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = wait / 1000000000ULL;
+    its.it_value.tv_nsec = wait % 1000000000ULL;
+    timerfd_settime(frame_fd, 0, &its, NULL);
+    f_frame_pending = true;
 }
 
 // ================================================================================= //
-// isRotatable
+// draw_frame
 //
-// It tells if the current piece can be rotated.
-// The argument indicates the rotation is clockwise or not.
+// It draws all panels marked as changed, and sends them to the terminal
+// by a single FLUSH().
 // ================================================================================= //
-bool GAME::isRotatable(bool clockwise)
+void GAME::draw_frame()
 {
-    int buff[NROW_PIECE][NCOL_PIECE];
-    bool f_rotatable = true;
-    for(int i = 0; i < NROW_PIECE; i++)
-    {
-        for(int j = 0; j < NCOL_PIECE; j++)
+    PROF_SCOPE(frame);
+    view->draw_cells();
+#ifdef WASTEDRIS_PROF
+    if(f_overlay)
+        draw_overlay(false);
+    else
+        view->put_message();
+#else
+    view->put_message();
+#endif
+    FLUSH();
+#ifdef WASTEDRIS_PROF
+    uint64_t now = PROF_NOW();
+    for(size_t i = 0; i < input_times_unshown.size(); i++)
+        PROF_ADD(input, now - input_times_unshown[i]);
+    input_times_unshown.clear();
+#endif
+}
+
+// ================================================================================= //
+// run
+//
+// This is the game loop running in its own thread.
+//
+// It sleeps in poll() until either the user gives keys, the terminal is resized,
+// the timer tells the current piece to fall, or a deferred frame is due.
+// So the thread does not wake up for nothing.
+// All keys in the input queue are given to handle_input, and then shown in one frame.
+// A timer expiration leads to the falls due on the gravity clock,
+// or to the next frame of the end movie.
+//
+// When it is told to quit, it stops at once, even in the middle of the end movie.
+// It returns when the game is not running and the end movie is over.
+// ================================================================================= //
+void GAME::run()
+{
+    struct pollfd fds[3];
+    fds[0].fd = wake_fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = timer_fd;
+    fds[1].events = POLLIN;
+    fds[2].fd = frame_fd;
+    fds[2].events = POLLIN;
+
+    while(isRunning() || isEnding())
+    {
+#ifdef WASTEDRIS_PROF
+        uint64_t t_wait = PROF_NOW();
+        int n_ready = poll(fds, 3, -1);
+        PROF_ADD(wait, PROF_NOW() - t_wait);
+        if(n_ready < 0)
+#else
+        if(poll(fds, 3, -1) < 0)
+#endif
         {
-            if(clockwise)
-                buff[j][NCOL_PIECE-1-i] = cur_piece[i][j];
-            else
-                buff[NROW_PIECE-1-j][i] = cur_piece[i][j];
+            if(errno == EINTR)
+                continue;
+            break;
         }
-    }
-
-    for(int i = 0; i < NROW_PIECE; i++)
-    {
-        for(int j = 0; j < NCOL_PIECE; j++)
+        if(fds[1].revents & POLLIN)
+        {
+            // the gravity clock finds out how many falls are due by itself.
+            // the movie goes by one frame per wakeup.
+            uint64_t n_expired;
+            if(read(timer_fd, &n_expired, sizeof(n_expired)) == sizeof(n_expired))
+            {
+                if(isEnding())
+                    step_ending();
+                else if(f_replay)
+                    play_replay();
+                else
+                    tick_gravity();
+            }
+        }
+        if(fds[0].revents & POLLIN)
+        {
+            uint64_t n_pushed;
+            if(read(wake_fd, &n_pushed, sizeof(n_pushed)) == sizeof(n_pushed))
+            {
+                KEY key;
+                while((isRunning() || isEnding()) && input_queue.pop(key))
+                {
+                    handle_input(key);
+#ifdef WASTEDRIS_PROF
+                    uint64_t t_push;
+                    if(input_time_queue.pop(t_push))
+                        input_times_unshown.push_back(t_push);
+#endif
+                }
+                // the screen after a resize is shown in the same frame
+                if(f_resized && isRunning())
+                {
+                    f_resized = 0;
+                    resize();
+                }
+                // all keys at hand are shown in one frame
+                if(isRunning())
+                    present();
+            }
+        }
+        if(fds[2].revents & POLLIN)
         {
-            int x = cur_p_x+j;
-            int y = cur_p_y+i;
-            if(buff[i][j]!=0)
+            uint64_t n_expired;
+            if(read(frame_fd, &n_expired, sizeof(n_expired)) == sizeof(n_expired))
             {
-                if(0<=x && x<ncol && 0<=y && y<nrow && bin[y][x]!=0)
-                    f_rotatable = false;
-                if(x < 0 || ncol <= x || nrow <= y)
-                    f_rotatable = false;
+                f_frame_pending = false;
+                if(isRunning())
+                    present();
             }
         }
+        if(f_quit)
+        {
+            f_stat = 0;
+            break;
+        }
     }
+}
 
-    return f_rotatable;
+// ================================================================================= //
+// elapsed_ms
+//
+// It returns the time since the start of the game in milliseconds.
+// ================================================================================= //
+uint32_t GAME::elapsed_ms() const
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    return (uint32_t)((now.tv_sec - t_start.tv_sec)*1000 + (now.tv_nsec - t_start.tv_nsec)/1000000);
+}
+
+// ================================================================================= //
+// set_timer_at
+//
+// It arms the timer to expire once at t_ms milliseconds from the start of the game.
+// If the time has already passed, it expires at once.
+// ================================================================================= //
+void GAME::set_timer_at(uint32_t t_ms)
+{
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    its.it_value.tv_sec = t_start.tv_sec + t_ms / 1000;
+    its.it_value.tv_nsec = t_start.tv_nsec + (t_ms % 1000) * 1000000L;
+    if(its.it_value.tv_nsec >= 1000000000L)
+    {
+        its.it_value.tv_sec++;
+        its.it_value.tv_nsec -= 1000000000L;
+    }
+    timerfd_settime(timer_fd, TFD_TIMER_ABSTIME, &its, NULL);
 }
 
 // ================================================================================= //
-// placePiece
+// play_replay
 //
-// It places the current piece into the bin.
+// It gives the engine all recorded actions whose time has come,
+// in the same way as the user and the gravity timer did.
+// Then, it waits for the next one. At the end of the replay, the game is aborted.
 // ================================================================================= //
-void GAME::placePiece()
+void GAME::play_replay()
 {
-    for(int i = 0; i < NROW_PIECE; i++)
+    uint32_t now = elapsed_ms();
+    while(isRunning() && rep_pending && rep_t <= now)
     {
-        for(int j = 0; j < NCOL_PIECE; j++)
+        if(rep_act == ACT_GRAVITY)
+            update();
+        else
         {
-            if(cur_piece[i][j] != 0)
-                bin[cur_p_y+i][cur_p_x+j] = cur_piece[i][j];
+            recorder.record(rep_act, rep_t);
+            view->mark_dirty(engine->step(rep_act));
         }
+        rep_pending = player.next(rep_act, rep_t);
     }
+    if(!isRunning())
+        return;
+
+    present();
+    if(rep_pending)
+        set_timer_at(rep_t);
+    else
+        abort();
 }
 
 // ================================================================================= //
@@ -775,3 +796,32 @@ int GAME::isRunning()
     return (f_stat == 1)? 1: 0;
 }
 
+// ================================================================================= //
+// isEnding
+//
+// it tells if the end movie is playing (f_stat == 2)
+// ================================================================================= //
+int GAME::isEnding()
+{
+    return (f_stat == 2)? 1: 0;
+}
+
+#ifdef WASTEDRIS_PROF
+// ================================================================================= //
+// draw_overlay
+//
+// It shows the stats of the instrumentation in the message box.
+// Unless forced, it is redrawn at most once a second, so it does not disturb the stats.
+// ================================================================================= //
+void GAME::draw_overlay(bool force)
+{
+    uint64_t now = PROF_NOW();
+    if(!force && now - t_overlay < 1000000000ULL)
+        return;
+    t_overlay = now;
+
+    std::vector<std::string> lines;
+    PROF::stats.lines(lines);
+    view->put_text(lines);
+}
+#endif
@@ -2,93 +2,158 @@
 #define _GAME_CORE_HPP
 
 #include <thread>
-#include <mutex>
+#include <atomic>
+#include <stdint.h>
+#include <time.h>
+#include <signal.h>
+#include <vector>
 #include "format_macro.hpp"
+#include "input_queue.hpp"
+#include "engine.hpp"
+#include "view.hpp"
+#include "replay.hpp"
+#include "input.hpp"
+#include "prof.hpp"
 
-class GAME
+// the most falls taken at once to catch up with the gravity clock
+#define MAX_FALLS_PER_TICK 4
+
+// options given to GAME::init_game
+struct GAME_OPTION
 {
-private:
-    // the size of the entire screen
-    int screen_width;
-    int screen_height;
+    // path to write the replay of the session to (NULL: not recorded)
+    const char *record_path;
+    // path of the replay to play instead of the user's input (NULL: the user plays)
+    const char *replay_path;
+    // # of rows and # of columns of the bin (a replay must be of the same size)
+    int nrow;
+    int ncol;
+    // the size of a cell in characters
+    int wcell;
+    int hcell;
 
-    // the top-left corner of the box where cells appear
-    int bin_start_x;
-    int bin_start_y;
+    GAME_OPTION(): record_path(NULL), replay_path(NULL),
+        nrow(NROW_BIN), ncol(NCOL_BIN), wcell(WCELL), hcell(HCELL)
+    {
+    }
+};
 
-    // # of rows and # of columns of the box in terms of cells 
+class GAME
+{
+private:
+    // # of rows and # of columns of the bin
     int nrow;
     int ncol;
 
-    // the top-left corner of the next box and the size
-    int next_start_x;
-    int next_start_y;
-    int next_width;
-    int next_height;
-
-    // the top-left corner of the message box and the size
-    int mess_start_x;
-    int mess_start_y;
-    int mess_width;
-    int mess_height;
-
-    // bin: 2D table holding stata of the cells
-    int **bin;
-    // canvas: a buffer holding color infor of the bin
-    int **canvas;
-    // shadow: a buffer holding color infor of the bin in the previous state
-    int **shadow;
-    // cur_piece: current piece and its location
-    int cur_piece[NROW_PIECE][NCOL_PIECE];
-    int cur_p_x, cur_p_y;
-    // next_piece: the piece which will be released
-    int next_piece[NROW_PIECE][NCOL_PIECE];
+    // engine: the state and the rules of the game
+    ENGINE *engine;
+    // view: the drawing of the engine's state
+    VIEW *view;
 
     // the status of the game
     // 0: stopped
     // 1: running
+    // 2: ending (the end movie is playing)
     // others: some error or anything else
-    int f_stat;
+    std::atomic<int> f_stat;
+    // the game is ending because the user has quit (not because it is over).
+    // then, the main thread is told by done_fd when the end movie is over.
+    bool f_quitting;
+    int done_fd;
+
+    // gravity timer (timerfd) and the interval between the falls in milliseconds
+    // (it gets shorter as the level goes up)
+    int timer_fd;
+    int fall_interval;
+    // the gravity clock runs at a fixed step on the monotonic clock.
+    // t_fall_tick: when the time was last added to the accumulator (in nanoseconds)
+    // fall_acc: the time not spent by falls yet (in nanoseconds)
+    // a fall is taken for every fall_interval in the accumulator, whenever the loop wakes up,
+    // so the pace does not drift with the time spent in drawing.
+    uint64_t t_fall_tick;
+    uint64_t fall_acc;
 
-    // counts of clearing full rows
-    int count_clearing_rows;
+    // frames are sent at most once per frame_interval nanoseconds (the display rate).
+    // the changes in between are drawn together in the next frame.
+    // frame_fd: timer (timerfd) expiring when a deferred frame is due
+    // t_last_frame: when the last frame was sent (monotonic, in nanoseconds)
+    // f_frame_pending: a frame is deferred and frame_fd is armed
+    int frame_fd;
+    uint64_t frame_interval;
+    uint64_t t_last_frame;
+    bool f_frame_pending;
 
-    // thread and mutex
+    // thread running the game loop
     std::thread t_update;
-    std::mutex mtx;
-    // step index
-    // 0: update the game
-    int n_step;
-    int i_step;
+    // keys given by the user, passed to the game loop
+    SPSC_QUEUE<KEY, 256> input_queue;
+    // eventfd to wake up the game loop when keys are pushed
+    int wake_fd;
+    // the game loop must finish as soon as possible
+    std::atomic<bool> f_quit;
+
+    // the terminal was resized (set by the SIGWINCH handler, which also wakes the game loop)
+    // signal_fd: wake_fd for the handler, and the action of SIGWINCH before the game
+    static volatile sig_atomic_t f_resized;
+    static int signal_fd;
+    struct sigaction old_winch;
+    static void on_winch(int sig);
+
+    // the start of the game on the monotonic clock (the origin of the replay times)
+    struct timespec t_start;
+    // recorder: writes every action given to the engine (if recording)
+    REPLAY_WRITER recorder;
+    // player: gives the recorded actions instead of the user (if replaying)
+    // rep_act, rep_t: the next recorded action and its time
+    // rep_pending: true if rep_act is not given yet
+    bool f_replay;
+    REPLAY_READER player;
+    ACTION rep_act;
+    uint32_t rep_t;
+    bool rep_pending;
+
+#ifdef WASTEDRIS_PROF
+    // the times the keys in input_queue were given (pushed and popped with them),
+    // and the times of the keys handled but not shown yet
+    SPSC_QUEUE<uint64_t, 256> input_time_queue;
+    std::vector<uint64_t> input_times_unshown;
+    // the stats are shown in the message box (toggled by 'p'), and when they were drawn
+    bool f_overlay;
+    uint64_t t_overlay;
+    void draw_overlay(bool force);
+#endif
 
     // pointer to the object (since this class is supposed to be singleton)
     static GAME* game;
 
-    GAME();
+    GAME(const GAME_OPTION &opt);
     ~GAME();
     void init_stat();
     void abort();
-    void play_endmovie();
-    void rand_next();
-    void copy_pieces();
-    void rotR_piece(int (*piece)[NCOL_PIECE]);
-    void rotL_piece(int (*piece)[NCOL_PIECE]);
-    void draw_background();
-    void draw_cells();
-    void put_message();
-    void clear_message();
+    void start_ending(bool quitting);
+    void step_ending();
+    void finish_ending();
     void update();
-    void eval_and_clean();
-    bool isMovable(int dx, int dy);
-    bool isRotatable(bool clockwise);
-    void placePiece();
+    void tick_gravity();
+    void set_gravity_timer();
+    void present();
+    void draw_frame();
+    void run();
+    void handle_input(KEY key);
+    void resize();
+    uint32_t elapsed_ms() const;
+    void set_timer_at(uint32_t t_ms);
+    void play_replay();
 
 public:
-    static GAME* init_game();
+    static GAME* init_game(const GAME_OPTION &opt = GAME_OPTION());
     static void kill_game();
 
-    int play_game(char c);
+    int play_game(KEY key);
+    int play_keys(const KEY *keys, int n_keys);
     int isRunning();
+    int isEnding();
+    int getDoneFd() const { return done_fd; }
 };
 
 #endif //_GAME_CORE_HPP
@@ -0,0 +1,131 @@
+// input.cpp
+//
+// This file contains the decoder of the keys typed by the user.
+//
+// escape sequences:
+//   ESC [ <params> <final>   (CSI, e.g., ESC [ C, or ESC [ 1 ; 5 C with a modifier)
+//   ESC O <final>            (SS3, sent in the application cursor mode)
+//   the final byte A/B/C/D is up/down/right/left. Other sequences are skipped.
+//
+
+#include "input.hpp"
+#include <string.h> // memcpy
+
+// ================================================================================= //
+// Constructor
+// ================================================================================= //
+KEY_PARSER::KEY_PARSER(): n_pending(0)
+{
+}
+
+// ================================================================================= //
+// parse_one
+//
+// It decodes one key from the beginning of the bytes.
+// It returns the number of bytes used (KEY_NONE if they do not make a key of the game),
+// or 0 if the bytes end in the middle of an escape sequence.
+// ================================================================================= //
+int KEY_PARSER::parse_one(const char *s, int n, KEY &key) const
+{
+    key = KEY_NONE;
+    switch(s[0])
+    {
+    case '\x04': key = KEY_QUIT; return 1;
+    case ' ':
+    case 'x': key = KEY_ROT_R; return 1;
+    case 'z': key = KEY_ROT_L; return 1;
+    case 'p': key = KEY_STATS; return 1;
+    case '\x1B': break;
+    default: return 1;
+    }
+
+    // escape sequence
+    if(n < 2)
+        return 0;
+    if(s[1] != '[' && s[1] != 'O')
+        return 1; // a lone ESC (or ESC with a key): the ESC is dropped
+    int i = 2;
+    if(s[1] == '[')
+    {
+        while(i < n && ((s[i] >= '0' && s[i] <= '9') || s[i] == ';'))
+            i++;
+    }
+    if(i >= n)
+        return (n < MAX_PENDING)? 0: n; // too long to be a key: thrown away
+    switch(s[i])
+    {
+    case 'A': key = KEY_UP; break;
+    case 'B': key = KEY_DOWN; break;
+    case 'C': key = KEY_RIGHT; break;
+    case 'D': key = KEY_LEFT; break;
+    default: break;
+    }
+    return i + 1;
+}
+
+// ================================================================================= //
+// parse
+//
+// It decodes the given bytes, following the incomplete sequence of the last call,
+// and stores the keys in the array. (it needs room for n + MAX_PENDING keys at most)
+// It returns the number of keys stored.
+// ================================================================================= //
+int KEY_PARSER::parse(const char *buff, int n, KEY *keys)
+{
+    // an incomplete sequence is joined with the head of the new bytes
+    char joined[2*MAX_PENDING];
+    int n_keys = 0;
+    if(n_pending > 0)
+    {
+        int n_head = (n < MAX_PENDING)? n: MAX_PENDING;
+        memcpy(joined, pending, n_pending);
+        memcpy(joined + n_pending, buff, n_head);
+        int n_joined = n_pending + n_head;
+        int off = 0;
+        // decode until the old bytes are used up
+        while(off < n_pending)
+        {
+            KEY key;
+            int used = parse_one(joined + off, n_joined - off, key);
+            if(used == 0)
+                break;
+            if(key != KEY_NONE)
+                keys[n_keys++] = key;
+            off += used;
+        }
+        if(off < n_pending)
+        {
+            // still incomplete (the new bytes were too few)
+            memmove(pending, pending + off, n_pending - off);
+            n_pending -= off;
+            if(n_pending + n > MAX_PENDING)
+            {
+                n_pending = 0;
+                return n_keys;
+            }
+            memcpy(pending + n_pending, buff, n);
+            n_pending += n;
+            return n_keys;
+        }
+        buff += off - n_pending;
+        n -= off - n_pending;
+        n_pending = 0;
+    }
+
+    int off = 0;
+    while(off < n)
+    {
+        KEY key;
+        int used = parse_one(buff + off, n - off, key);
+        if(used == 0)
+        {
+            n_pending = n - off;
+            memcpy(pending, buff + off, n_pending);
+            break;
+        }
+        if(key != KEY_NONE)
+            keys[n_keys++] = key;
+        off += used;
+    }
+    return n_keys;
+}
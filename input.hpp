@@ -0,0 +1,48 @@
+// input.hpp
+//
+// Decoding of the bytes typed by the user into keys.
+// The terminal sends an arrow key as an escape sequence of three bytes (e.g., ESC [ C),
+// so a key is not always a byte. All bytes available are read at once,
+// and the complete sequences among them are decoded in one pass.
+// An incomplete sequence at the end is kept until the rest of it arrives.
+//
+
+#ifndef _INPUT_HPP
+#define _INPUT_HPP
+
+#include <stdint.h>
+
+// keys given to the game
+enum KEY
+{
+    KEY_NONE = 0,
+    KEY_LEFT,      // left arrow
+    KEY_RIGHT,     // right arrow
+    KEY_DOWN,      // down arrow
+    KEY_UP,        // up arrow
+    KEY_ROT_R,     // space or 'x'
+    KEY_ROT_L,     // 'z'
+    KEY_STATS,     // 'p'
+    KEY_QUIT       // Ctrl-D
+};
+
+class KEY_PARSER
+{
+public:
+    // the longest escape sequence kept over reads
+    static const int MAX_PENDING = 16;
+
+private:
+    // the bytes of an incomplete escape sequence carried over from the last parse
+    char pending[MAX_PENDING];
+    int n_pending;
+
+    int parse_one(const char *s, int n, KEY &key) const;
+
+public:
+    KEY_PARSER();
+
+    int parse(const char *buff, int n, KEY *keys);
+};
+
+#endif //_INPUT_HPP
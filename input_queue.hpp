@@ -0,0 +1,62 @@
+// input_queue.hpp
+//
+// A lock-free ring buffer to pass input events from one thread to another.
+// Exactly one thread pushes (the producer) and exactly one thread pops (the consumer).
+// Neither side ever waits for the other.
+//
+
+#ifndef _INPUT_QUEUE_HPP
+#define _INPUT_QUEUE_HPP
+
+#include <atomic>
+#include <cstddef>
+
+// N must be a power of two
+template <typename T, size_t N>
+class SPSC_QUEUE
+{
+private:
+    static_assert(N > 0 && (N & (N-1)) == 0, "the size of SPSC_QUEUE must be a power of two");
+
+    // the slots of the ring
+    T buff[N];
+
+    // head: the index of the next slot to pop (written only by the consumer)
+    // tail: the index of the next slot to push (written only by the producer)
+    // the indices grow forever and are wrapped when the slots are accessed.
+    // they are kept on separate cache lines so that both sides do not fight over one line.
+    char pad0[64];
+    std::atomic<size_t> head;
+    char pad1[64];
+    std::atomic<size_t> tail;
+    char pad2[64];
+
+public:
+    SPSC_QUEUE(): head(0), tail(0)
+    {
+    }
+
+    // it returns false if the ring is full. (only the producer calls it)
+    bool push(const T& v)
+    {
+        size_t t = tail.load(std::memory_order_relaxed);
+        if(t - head.load(std::memory_order_acquire) == N)
+            return false;
+        buff[t & (N-1)] = v;
+        tail.store(t + 1, std::memory_order_release);
+        return true;
+    }
+
+    // it returns false if the ring is empty. (only the consumer calls it)
+    bool pop(T& v)
+    {
+        size_t h = head.load(std::memory_order_relaxed);
+        if(h == tail.load(std::memory_order_acquire))
+            return false;
+        v = buff[h & (N-1)];
+        head.store(h + 1, std::memory_order_release);
+        return true;
+    }
+};
+
+#endif //_INPUT_QUEUE_HPP
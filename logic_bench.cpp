@@ -0,0 +1,267 @@
+// logic_bench.cpp
+//
+// This file contains the main function of wastedris-logic-bench.
+// It times the rules of the engine one by one on boards filled up to several heights:
+// isMovable, isRotatable, placePiece, eval_and_clean and rand_next.
+// Each number is the best of a few runs, in nanoseconds per call.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <chrono>
+#include <stdlib.h>
+#include <stdio.h> // sscanf
+#include <unistd.h> // getopt
+#include "engine.hpp"
+
+using namespace std;
+
+// # of runs of each benchmark (the best one is reported)
+#define N_REPEAT 5
+// # of positions the calls go around
+#define N_POSITION 256
+
+// the results are added here so that the calls are not optimized out
+static volatile int sink;
+
+// ================================================================================= //
+// bench
+//
+// It calls body(i) for i = 0 .. n_iter-1, N_REPEAT times,
+// and returns the best time in nanoseconds per call.
+// ================================================================================= //
+template <typename F>
+static double bench(long n_iter, F body)
+{
+    double best = 1e30;
+    for(int r = 0; r < N_REPEAT; r++)
+    {
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        for(long i = 0; i < n_iter; i++)
+            body(i);
+        chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+        double ns = chrono::duration<double, nano>(t1 - t0).count() / n_iter;
+        if(ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+// ================================================================================= //
+// bench_batch
+//
+// It is the same as bench, but for calls which change their input. Before every
+// N_POSITION calls, prepare() sets the inputs again out of the timed region,
+// and only body(i) for i = 0 .. N_POSITION-1 is timed.
+// ================================================================================= //
+template <typename P, typename F>
+static double bench_batch(long n_iter, P prepare, F body)
+{
+    long n_batch = (n_iter + N_POSITION - 1) / N_POSITION;
+    double best = 1e30;
+    for(int r = 0; r < N_REPEAT; r++)
+    {
+        chrono::steady_clock::duration t = chrono::steady_clock::duration::zero();
+        for(long b = 0; b < n_batch; b++)
+        {
+            prepare();
+            chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+            for(int i = 0; i < N_POSITION; i++)
+                body(i);
+            t += chrono::steady_clock::now() - t0;
+        }
+        double ns = chrono::duration<double, nano>(t).count() / (n_batch * N_POSITION);
+        if(ns < best)
+            best = ns;
+    }
+    return best;
+}
+
+// ================================================================================= //
+// make_fill
+//
+// It fills the lowest `height` rows of the bin at random like a game in progress:
+// about 3/4 of the cells are filled, and every row has at least one hole.
+// ================================================================================= //
+static void make_fill(RNG &rng, int nrow, int ncol, int height, vector<uint8_t> &colors)
+{
+    colors.assign(nrow*ncol, 0);
+    for(int r = nrow - height; r < nrow; r++)
+    {
+        uint8_t *row = &colors[r*ncol];
+        for(int c = 0; c < ncol; c++)
+            row[c] = (rng.below(4) != 0)? 1 + rng.below(6): 0;
+        row[rng.below(ncol)] = 0;
+    }
+}
+
+// ================================================================================= //
+// fits_in_bin
+//
+// It tells if no cell of the piece is above the bin. The board has room there, but the
+// colors do not, and placePiece would write out of them.
+// ================================================================================= //
+static bool fits_in_bin(int shape, int rot, int y)
+{
+    for(int i = 0; i < NROW_PIECE && y + i < 0; i++)
+        for(int j = 0; j < NCOL_PIECE; j++)
+            if(PIECE_CELL(PIECE_TABLE[shape][rot], i, j))
+                return false;
+    return true;
+}
+
+// ================================================================================= //
+// make_engines
+//
+// It makes engines holding the fill with a random piece at a random place where it fits,
+// so the calls see various pieces near the surface as in the game.
+// ================================================================================= //
+static void make_engines(RNG &rng, int nrow, int ncol, const vector<uint8_t> &colors, int height,
+                         vector<ENGINE*> &engines)
+{
+    while(engines.size() < N_POSITION)
+    {
+        ENGINE *engine = new ENGINE(nrow, ncol, rng.next());
+        int shape = rng.below(N_SHAPE);
+        int rot = rng.below(N_ROT);
+        int x = (int)rng.below(ncol + NCOL_PIECE - 1) - (NCOL_PIECE - 1);
+        // around the surface of the fill
+        int y = nrow - height - NROW_PIECE + (int)rng.below(NROW_PIECE + 1);
+        engine->load(&colors[0], shape, rot, x, y);
+        if(engine->getBoard().collides(PIECE_TABLE[shape][rot], x, y) || !fits_in_bin(shape, rot, y))
+            delete engine;
+        else
+            engines.push_back(engine);
+    }
+}
+
+static void free_engines(vector<ENGINE*> &engines)
+{
+    for(size_t i = 0; i < engines.size(); i++)
+        delete engines[i];
+    engines.clear();
+}
+
+static void usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [-n iterations] [-s seed] [-d ROWSxCOLS]" << endl;
+}
+
+static void report(const char *name, int height, double ns)
+{
+    cout << left << setw(28) << name << right << setw(6) << height
+         << fixed << setprecision(2) << setw(12) << ns << endl;
+}
+
+// ============================================================================== //
+// main
+//
+// Description:
+//   For each height of the fill, it makes the positions, and times the rules on them.
+//   eval_and_clean with full rows changes the board, so the positions are loaded again
+//   before every round over them, and only the calls themselves are timed.
+//
+// ============================================================================== //
+int main(int argc, char **argv)
+{
+    long n_iter = 1000000;
+    uint32_t seed = 1;
+    int nrow = NROW_BIN;
+    int ncol = NCOL_BIN;
+
+    int c;
+    while((c = getopt(argc, argv, "n:s:d:h")) != -1)
+    {
+        switch(c)
+        {
+        case 'n': n_iter = atol(optarg); break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'd':
+            if(sscanf(optarg, "%dx%d", &nrow, &ncol) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(n_iter <= 0)
+        n_iter = 1;
+    if(!ENGINE::isValidSize(nrow, ncol))
+    {
+        cerr << "the bin must be " << MIN_NROW_BIN << "x" << MIN_NCOL_BIN
+             << " to " << MAX_NROW_BIN << "x" << MAX_NCOL_BIN << endl;
+        return 1;
+    }
+
+    RNG rng(seed);
+
+    cout << left << setw(28) << "benchmark" << right << setw(6) << "fill" << setw(12) << "ns/call" << endl;
+
+    int heights[] = {0, nrow/4, nrow/2, 3*nrow/4};
+    for(size_t ih = 0; ih < sizeof(heights)/sizeof(heights[0]); ih++)
+    {
+        int height = heights[ih];
+        vector<uint8_t> colors;
+        make_fill(rng, nrow, ncol, height, colors);
+        vector<ENGINE*> engines;
+        make_engines(rng, nrow, ncol, colors, height, engines);
+
+        report("isMovable", height, bench(n_iter, [&](long i) {
+            const ENGINE *e = engines[i % N_POSITION];
+            sink += e->isMovable(-1, 0) + e->isMovable(1, 0) + e->isMovable(0, 1);
+        }) / 3);
+        report("isRotatable", height, bench(n_iter, [&](long i) {
+            const ENGINE *e = engines[i % N_POSITION];
+            sink += e->isRotatable(true) + e->isRotatable(false);
+        }) / 2);
+        // placing a piece again at the same place changes nothing
+        report("placePiece", height, bench(n_iter, [&](long i) {
+            engines[i % N_POSITION]->placePiece();
+        }));
+        // no row is full after the first round
+        report("eval_and_clean (no row)", height, bench(n_iter, [&](long i) {
+            sink += engines[i % N_POSITION]->eval_and_clean();
+        }));
+
+        // k full rows at the surface of the fill, and the piece was placed there
+        for(int k = 1; k <= NROW_PIECE; k++)
+        {
+            if(height < k)
+                continue;
+            vector<uint8_t> full = colors;
+            int y = nrow - height;
+            for(int r = y; r < y + k; r++)
+                for(int col = 0; col < ncol; col++)
+                    full[r*ncol + col] = 1;
+            double t_clean = bench_batch(n_iter/10 + 1, [&]() {
+                for(int i = 0; i < N_POSITION; i++)
+                    engines[i]->load(&full[0], 0, 0, 0, y);
+            }, [&](int i) {
+                sink += engines[i]->eval_and_clean();
+            });
+            const char *names[] = {"", "eval_and_clean (1 row)", "eval_and_clean (2 rows)",
+                "eval_and_clean (3 rows)", "eval_and_clean (4 rows)"};
+            report(names[k], height, t_clean);
+        }
+
+        free_engines(engines);
+    }
+
+    ENGINE engine(nrow, ncol, seed);
+    report("rand_next", 0, bench(n_iter, [&](long) {
+        engine.rand_next();
+        sink += engine.getNextShape();
+    }));
+    engine.setBag(true);
+    report("rand_next (7-bag)", 0, bench(n_iter, [&](long) {
+        engine.rand_next();
+        sink += engine.getNextShape();
+    }));
+
+    return 0;
+}
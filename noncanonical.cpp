@@ -13,6 +13,8 @@
 #include <unistd.h>
 #include <termios.h>
 #include <cstdlib> // for atexit
+#include <cerrno>
+#include <poll.h>
 
 using namespace std;
 
@@ -24,12 +26,31 @@ void reset_input_mode (void)
     tcsetattr (STDIN_FILENO, TCSANOW, &saved_attributes);
 }
 
-char readOneChar()
+// it waits for at least one byte, and reads all bytes available at once (up to size).
+// it returns the number of bytes read, or 0 if stdin is closed.
+// it stops waiting and returns -1 if stop_fd becomes readable (-1: no such fd).
+int readChars(char *buff, int size, int stop_fd)
 {
-    char c;
-    if(read(STDIN_FILENO, &c, 1) != 1)
-        c = '\0';
-    return c;
+    struct pollfd fds[2];
+    fds[0].fd = STDIN_FILENO;
+    fds[0].events = POLLIN;
+    fds[1].fd = stop_fd;
+    fds[1].events = POLLIN;
+    fds[1].revents = 0;
+    while(poll(fds, 2, -1) < 0)
+    {
+        if(errno != EINTR)
+            return 0;
+    }
+    if(fds[1].revents & POLLIN)
+        return -1;
+
+    ssize_t n;
+    do
+    {
+        n = read(STDIN_FILENO, buff, size);
+    } while(n < 0 && errno == EINTR);
+    return (n > 0)? n: 0;
 }
 
 int set_input_mode (void)
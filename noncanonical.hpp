@@ -5,6 +5,6 @@
 #define _NONCANONICAL_HPP
 
 int set_input_mode (void);
-char readOneChar();
+int readChars(char *buff, int size, int stop_fd = -1);
 
 #endif //_NONCANONICAL_HPP
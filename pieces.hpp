@@ -0,0 +1,89 @@
+// pieces.hpp
+//
+// The shapes of the pieces and all of their rotations.
+// A piece is represented by a pair of indices (shape, rotation),
+// and its 4x4 cells are looked up in the table generated at compile time.
+//
+
+#ifndef _PIECES_HPP
+#define _PIECES_HPP
+
+#include <stdint.h>
+#include "dimension.hpp"
+
+// the bit (4*i + j) of a piece mask is the cell at the row i and the column j
+// of the 4x4 piece.
+typedef uint16_t PIECE_MASK;
+
+// tells if the cell at the row i and the column j of a piece mask is filled
+#define PIECE_CELL(mask,i,j) ((((mask) >> (NCOL_PIECE*(i) + (j))) & 1) != 0)
+
+// # of shapes and # of rotation states of each shape
+#define N_SHAPE 7
+#define N_ROT 4
+
+// ================================================================================= //
+// rotation at compile time
+//
+// rotR_mask rotates a mask clockwise: the cell (i, j) moves to (j, 3-i).
+// rotN_mask rotates a mask clockwise n times.
+// ================================================================================= //
+constexpr PIECE_MASK rotR_bits(PIECE_MASK mask, int k)
+{
+    return (k == NROW_PIECE*NCOL_PIECE)? 0:
+        (PIECE_MASK)(((mask >> k) & 1)? (1 << (NCOL_PIECE*(k%NCOL_PIECE) + NROW_PIECE-1 - k/NCOL_PIECE)): 0)
+        | rotR_bits(mask, k + 1);
+}
+constexpr PIECE_MASK rotR_mask(PIECE_MASK mask)
+{
+    return rotR_bits(mask, 0);
+}
+constexpr PIECE_MASK rotN_mask(PIECE_MASK mask, int n)
+{
+    return (n == 0)? mask: rotN_mask(rotR_mask(mask), n - 1);
+}
+
+// ================================================================================= //
+// the shapes in the rotation 0
+//
+//   I: . . # .   O: . . . .   T: . . # .   S: . . . .
+//      . . # .      . # # .      . # # .      . . # #
+//      . . # .      . # # .      . . # .      . # # .
+//      . . # .      . . . .      . . . .      . . . .
+//
+//   Z: . . . .   J: . . # .   L: . . . .
+//      . # # .      . . # .      . # # .
+//      . . # #      . # # .      . . # .
+//      . . . .      . . . .      . . # .
+// ================================================================================= //
+#define SHAPE_I 0x4444
+#define SHAPE_O 0x0660
+#define SHAPE_T 0x0464
+#define SHAPE_S 0x06C0
+#define SHAPE_Z 0x0C60
+#define SHAPE_J 0x0644
+#define SHAPE_L 0x4460
+
+#define PIECE_ROTATIONS(shape) \
+    { rotN_mask(shape,0), rotN_mask(shape,1), rotN_mask(shape,2), rotN_mask(shape,3) }
+
+// PIECE_TABLE[shape][rot]: the mask of the shape rotated clockwise rot times
+static constexpr PIECE_MASK PIECE_TABLE[N_SHAPE][N_ROT] = {
+    PIECE_ROTATIONS(SHAPE_I),
+    PIECE_ROTATIONS(SHAPE_O),
+    PIECE_ROTATIONS(SHAPE_T),
+    PIECE_ROTATIONS(SHAPE_S),
+    PIECE_ROTATIONS(SHAPE_Z),
+    PIECE_ROTATIONS(SHAPE_J),
+    PIECE_ROTATIONS(SHAPE_L)
+};
+
+#undef PIECE_ROTATIONS
+
+// the rotation state after turning clockwise / anti-clockwise
+#define ROT_R(rot) (((rot) + 1) % N_ROT)
+#define ROT_L(rot) (((rot) + N_ROT - 1) % N_ROT)
+
+static_assert(rotN_mask(SHAPE_T, N_ROT) == SHAPE_T, "four rotations must give the original shape");
+
+#endif //_PIECES_HPP
@@ -0,0 +1,161 @@
+// prof.cpp
+//
+// This file contains the histograms of the instrumentation (prof.hpp).
+// Nothing is compiled unless WASTEDRIS_PROF is defined.
+//
+
+#include "prof.hpp"
+
+#ifdef WASTEDRIS_PROF
+
+#include <time.h>
+#include "renderer.hpp"
+
+using namespace std;
+
+PROF PROF::stats;
+
+// ================================================================================= //
+// PROF_HIST
+// ================================================================================= //
+PROF_HIST::PROF_HIST(): n(0), sum_ns(0), max_ns(0)
+{
+    for(int k = 0; k < PROF_N_BUCKET; k++)
+        count[k] = 0;
+}
+
+void PROF_HIST::add(uint64_t ns)
+{
+    int k = (ns == 0)? 0: 63 - __builtin_clzll(ns);
+    if(k >= PROF_N_BUCKET)
+        k = PROF_N_BUCKET - 1;
+    count[k]++;
+    n++;
+    sum_ns += ns;
+    if(ns > max_ns)
+        max_ns = ns;
+}
+
+// ================================================================================= //
+// percentile
+//
+// It returns the upper end of the bucket where the given percentile falls,
+// but not more than the maximum. (so it is accurate within a factor of two)
+// ================================================================================= //
+uint64_t PROF_HIST::percentile(int pct) const
+{
+    if(n == 0)
+        return 0;
+    uint64_t rank = (n*pct + 99)/100;
+    uint64_t acc = 0;
+    for(int k = 0; k < PROF_N_BUCKET; k++)
+    {
+        acc += count[k];
+        if(acc >= rank)
+        {
+            uint64_t upper = ((uint64_t)2) << k;
+            return (upper < max_ns)? upper: max_ns;
+        }
+    }
+    return max_ns;
+}
+
+// ================================================================================= //
+// now_ns
+//
+// the monotonic clock in nanoseconds
+// ================================================================================= //
+uint64_t PROF::now_ns()
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec*1000000000ULL + ts.tv_nsec;
+}
+
+// ================================================================================= //
+// format_ns
+//
+// It writes a time with a unit in a few characters.
+// ================================================================================= //
+static void format_ns(char *buff, size_t size, uint64_t ns)
+{
+    if(ns < 1000)
+        snprintf(buff, size, "%lluns", (unsigned long long)ns);
+    else if(ns < 1000000)
+        snprintf(buff, size, "%.1fus", ns/1e3);
+    else if(ns < 1000000000)
+        snprintf(buff, size, "%.1fms", ns/1e6);
+    else
+        snprintf(buff, size, "%.1fs", ns/1e9);
+}
+
+// ================================================================================= //
+// lines
+//
+// It summarizes the stats in short lines that fit in the message box.
+// ================================================================================= //
+void PROF::lines(vector<string> &out) const
+{
+    const char *names[] = {"input", "frame", "draw", "flush", "wait"};
+    const PROF_HIST *hists[] = {&input, &frame, &draw, &flush, &wait};
+    char buff[64], t50[16], t99[16];
+
+    out.clear();
+    for(int i = 0; i < 5; i++)
+    {
+        format_ns(t50, sizeof(t50), hists[i]->percentile(50));
+        format_ns(t99, sizeof(t99), hists[i]->percentile(99));
+        snprintf(buff, sizeof(buff), "%-5s n%9llu", names[i], (unsigned long long)hists[i]->n);
+        out.push_back(buff);
+        snprintf(buff, sizeof(buff), " %7s %7s", t50, t99);
+        out.push_back(buff);
+    }
+    const RENDER_STAT &st = RENDERER::frame.getStat();
+    snprintf(buff, sizeof(buff), "bytes %10llu", st.n_bytes);
+    out.push_back(buff);
+    snprintf(buff, sizeof(buff), "B/frm %10.1f", st.n_frames? (double)st.n_bytes/st.n_frames: 0.0);
+    out.push_back(buff);
+    snprintf(buff, sizeof(buff), "write %10llu", st.n_writes);
+    out.push_back(buff);
+}
+
+// ================================================================================= //
+// dump
+//
+// It writes all stats including the whole histograms.
+// ================================================================================= //
+void PROF::dump(FILE *fp) const
+{
+    const char *names[] = {"input latency", "frame time", "draw_cells", "flush", "poll wait"};
+    const PROF_HIST *hists[] = {&input, &frame, &draw, &flush, &wait};
+    char t[16];
+
+    for(int i = 0; i < 5; i++)
+    {
+        const PROF_HIST &h = *hists[i];
+        fprintf(fp, "%s: n %llu", names[i], (unsigned long long)h.n);
+        if(h.n > 0)
+        {
+            format_ns(t, sizeof(t), h.sum_ns/h.n);
+            fprintf(fp, ", mean %s", t);
+            format_ns(t, sizeof(t), h.percentile(50));
+            fprintf(fp, ", p50 %s", t);
+            format_ns(t, sizeof(t), h.percentile(99));
+            fprintf(fp, ", p99 %s", t);
+            format_ns(t, sizeof(t), h.max_ns);
+            fprintf(fp, ", max %s", t);
+        }
+        fprintf(fp, "\n");
+        for(int k = 0; k < PROF_N_BUCKET; k++)
+        {
+            if(h.count[k] == 0)
+                continue;
+            format_ns(t, sizeof(t), ((uint64_t)1) << k);
+            fprintf(fp, "  >= %8s: %llu\n", t, (unsigned long long)h.count[k]);
+        }
+    }
+    const RENDER_STAT &st = RENDERER::frame.getStat();
+    fprintf(fp, "output: %llu bytes, %llu frames, %llu write() calls\n", st.n_bytes, st.n_frames, st.n_writes);
+}
+
+#endif //WASTEDRIS_PROF
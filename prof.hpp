@@ -0,0 +1,91 @@
+// prof.hpp
+//
+// Instrumentation of the hot paths of the game.
+// It is compiled in only if WASTEDRIS_PROF is defined (cmake -DWASTEDRIS_PROF=ON ..).
+// Otherwise, all PROF_* macros are empty and nothing is measured.
+//
+// The times are taken by the monotonic clock, and kept in histograms of
+// power-of-two buckets in nanoseconds. All histograms are filled by the game loop thread,
+// so they need no lock.
+//
+//   input:  from a key given to play_game until the frame showing it is flushed
+//   frame:  drawing and flushing one frame (all changes since the last frame)
+//   draw:   draw_cells
+//   flush:  sending a frame to the terminal (FLUSH)
+//   wait:   the game loop sleeping in poll()
+//
+
+#ifndef _PROF_HPP
+#define _PROF_HPP
+
+#include <stdint.h>
+#include <stdio.h>
+
+#ifdef WASTEDRIS_PROF
+
+#include <string>
+#include <vector>
+
+// # of buckets: the bucket k holds the times in [2^k, 2^(k+1)) nanoseconds
+#define PROF_N_BUCKET 40
+
+struct PROF_HIST
+{
+    uint64_t count[PROF_N_BUCKET];
+    uint64_t n;
+    uint64_t sum_ns;
+    uint64_t max_ns;
+
+    PROF_HIST();
+    void add(uint64_t ns);
+    uint64_t percentile(int pct) const;
+};
+
+class PROF
+{
+public:
+    PROF_HIST input;
+    PROF_HIST frame;
+    PROF_HIST draw;
+    PROF_HIST flush;
+    PROF_HIST wait;
+
+    // the stats of the running program
+    static PROF stats;
+
+    static uint64_t now_ns();
+
+    void lines(std::vector<std::string> &out) const;
+    void dump(FILE *fp) const;
+};
+
+// it adds the time from its construction to its destruction to a histogram
+class PROF_TIMER
+{
+private:
+    PROF_HIST &hist;
+    uint64_t t_begin;
+
+public:
+    PROF_TIMER(PROF_HIST &hist): hist(hist), t_begin(PROF::now_ns())
+    {
+    }
+    ~PROF_TIMER()
+    {
+        hist.add(PROF::now_ns() - t_begin);
+    }
+};
+
+#define PROF_NOW() PROF::now_ns()
+#define PROF_SCOPE(name) PROF_TIMER prof_timer_##name(PROF::stats.name)
+#define PROF_ADD(name,ns) PROF::stats.name.add(ns)
+
+#else
+
+#define PROF_NOW() ((uint64_t)0)
+#define PROF_SCOPE(name)
+#define PROF_ADD(name,ns)
+
+#endif //WASTEDRIS_PROF
+
+#endif //_PROF_HPP
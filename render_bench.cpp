@@ -0,0 +1,295 @@
+// render_bench.cpp
+//
+// This file contains the main function of wastedris-render-bench.
+// It drives an engine through a script of actions, draws every step with a VIEW
+// exactly as the game loop does, and sends the frames to a sink instead of the terminal.
+// Then, it reports what the frames cost: bytes, escape sequences and write() calls
+// per frame, and the percentiles of the time to compose and send a frame.
+//
+// The script is either a replay file (identical workloads across runs and builds),
+// or pieces dropped at random places from a seed.
+//
+
+#include <iostream>
+#include <iomanip>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <algorithm>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h> // sscanf
+#include <unistd.h> // getopt, pipe
+#include <fcntl.h>
+#include "engine.hpp"
+#include "view.hpp"
+#include "replay.hpp"
+#include "format_macro.hpp"
+
+using namespace std;
+
+// ================================================================================= //
+// SCRIPT
+//
+// It tells the next action to take.
+// From a replay, the recorded actions are taken in order.
+// Otherwise, each piece is turned and moved toward a random place, then it falls.
+// ================================================================================= //
+class SCRIPT
+{
+private:
+    REPLAY_READER *reader;
+    RNG rng;
+    // the place the current piece is going to
+    int target_rot, target_x;
+    bool f_target;
+
+public:
+    SCRIPT(REPLAY_READER *reader, uint32_t seed): reader(reader), rng(seed), target_rot(0), target_x(0), f_target(false)
+    {
+    }
+
+    // it returns false when the replay ends
+    bool next(const ENGINE &engine, ACTION &act)
+    {
+        if(reader != NULL)
+        {
+            uint32_t t_ms;
+            return reader->next(act, t_ms);
+        }
+        if(!f_target)
+        {
+            target_rot = rng.below(N_ROT);
+            target_x = (int)rng.below(engine.getNCol() + NCOL_PIECE - 1) - (NCOL_PIECE - 1);
+            f_target = true;
+        }
+        if(engine.getCurRot() != target_rot && engine.isRotatable(true))
+            act = ACT_ROT_R;
+        else if(engine.getCurX() > target_x && engine.isMovable(-1, 0))
+            act = ACT_LEFT;
+        else if(engine.getCurX() < target_x && engine.isMovable(1, 0))
+            act = ACT_RIGHT;
+        else
+            act = ACT_GRAVITY;
+        return true;
+    }
+
+    // the current piece is locked, and the next one needs a new place
+    void locked()
+    {
+        f_target = false;
+    }
+};
+
+// ================================================================================= //
+// drain
+//
+// It reads and throws away everything from the read end of the pipe sink.
+// ================================================================================= //
+static void drain(int fd)
+{
+    char buff[1 << 16];
+    while(read(fd, buff, sizeof(buff)) > 0)
+        ;
+}
+
+static void usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [-f frames] [-s seed] [-d ROWSxCOLS] [-c WxH] [-r replay] [-o null|pipe]" << endl;
+}
+
+// ============================================================================== //
+// main
+//
+// Description:
+//   It parses the options, sets up the sink, and draws the frames.
+//   A frame is one action given to the engine and everything it changes on the screen,
+//   composed and flushed as the game loop does.
+//   When a game is over, the next one starts with a full redraw of the screen.
+//   The bin and the cells have the sizes given by -d and -c (a replay has its own bin).
+//
+// ============================================================================== //
+int main(int argc, char **argv)
+{
+    long n_frames = 20000;
+    uint32_t seed = 1;
+    const char *replay_path = NULL;
+    bool f_pipe = false;
+    int nrow = NROW_BIN;
+    int ncol = NCOL_BIN;
+    int wcell = WCELL;
+    int hcell = HCELL;
+
+    int c;
+    while((c = getopt(argc, argv, "f:s:d:c:r:o:h")) != -1)
+    {
+        switch(c)
+        {
+        case 'f': n_frames = atol(optarg); break;
+        case 'd':
+            if(sscanf(optarg, "%dx%d", &nrow, &ncol) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            if(sscanf(optarg, "%dx%d", &wcell, &hcell) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 's': seed = strtoul(optarg, NULL, 0); break;
+        case 'r': replay_path = optarg; break;
+        case 'o':
+            if(strcmp(optarg, "null") == 0)
+                f_pipe = false;
+            else if(strcmp(optarg, "pipe") == 0)
+                f_pipe = true;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(n_frames <= 0 || !ENGINE::isValidSize(nrow, ncol) || wcell < 2 || hcell < 1)
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    REPLAY_READER reader;
+    bool f_bag = false;
+    if(replay_path != NULL)
+    {
+        if(!reader.open(replay_path))
+        {
+            cerr << "cannot read the replay: " << replay_path << endl;
+            return 1;
+        }
+        nrow = reader.getHeader().nrow;
+        ncol = reader.getHeader().ncol;
+        seed = reader.getHeader().seed;
+        f_bag = (reader.getHeader().flags & REPLAY_F_BAG) != 0;
+        if(!ENGINE::isValidSize(nrow, ncol))
+        {
+            cerr << "the replay has an invalid bin size: " << nrow << "x" << ncol << endl;
+            return 1;
+        }
+    }
+
+    // the sink: /dev/null, or a pipe drained by another thread
+    int sink_fd = -1;
+    int pipe_fds[2] = {-1, -1};
+    thread t_drain;
+    if(f_pipe)
+    {
+        if(pipe(pipe_fds) != 0)
+        {
+            cerr << "cannot create a pipe" << endl;
+            return 1;
+        }
+        sink_fd = pipe_fds[1];
+        t_drain = thread(drain, pipe_fds[0]);
+    }
+    else
+    {
+        sink_fd = open("/dev/null", O_WRONLY);
+        if(sink_fd < 0)
+        {
+            cerr << "cannot open /dev/null" << endl;
+            return 1;
+        }
+    }
+    FRAME.setFd(sink_fd);
+    FRAME.setCountEscapes(true);
+
+    ENGINE engine(nrow, ncol, seed);
+    engine.setBag(f_bag);
+    engine.init_stat();
+    VIEW view(&engine, wcell, hcell);
+    SCRIPT script(replay_path != NULL? &reader: NULL, seed);
+
+    view.reset();
+    view.draw_background();
+    view.draw_cells();
+    FLUSH();
+    FRAME.resetStat();
+
+    vector<double> frame_us;
+    frame_us.reserve(n_frames);
+    long n_games = 1;
+    chrono::steady_clock::time_point t_begin = chrono::steady_clock::now();
+    for(long i = 0; i < n_frames; i++)
+    {
+        ACTION act;
+        if(!script.next(engine, act))
+            break;
+
+        chrono::steady_clock::time_point t0 = chrono::steady_clock::now();
+        int events = engine.step(act);
+        if(events & EV_OVER)
+        {
+            // a replay ends with its game. otherwise, the next game starts.
+            if(replay_path != NULL)
+                break;
+            engine.init_stat();
+            view.reset();
+            view.draw_background();
+            n_games++;
+        }
+        else
+            view.mark_dirty(events);
+        view.draw_cells();
+        view.put_message();
+        FLUSH();
+        chrono::steady_clock::time_point t1 = chrono::steady_clock::now();
+        frame_us.push_back(chrono::duration<double, micro>(t1 - t0).count());
+
+        if(events & EV_LOCKED)
+            script.locked();
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t_begin).count();
+
+    RENDER_STAT stat = FRAME.getStat();
+    FRAME.setFd(STDOUT_FILENO);
+    close(sink_fd);
+    if(f_pipe)
+    {
+        t_drain.join();
+        close(pipe_fds[0]);
+    }
+
+    size_t n = frame_us.size();
+    if(n == 0)
+    {
+        cerr << "no frame was drawn" << endl;
+        return 1;
+    }
+    sort(frame_us.begin(), frame_us.end());
+    double p50 = frame_us[n/2];
+    double p99 = frame_us[min(n - 1, n*99/100)];
+    double mean = 0;
+    for(size_t i = 0; i < n; i++)
+        mean += frame_us[i];
+    mean /= n;
+
+    cout << "sink:               " << (f_pipe? "pipe": "/dev/null") << endl;
+    cout << "script:             " << (replay_path != NULL? replay_path: "random drops") << endl;
+    cout << "frames:             " << n << " (" << n_games << " games)" << endl;
+    cout << "frames/sec:         " << n/sec << endl;
+    cout << fixed << setprecision(2);
+    cout << "bytes/frame:        " << (double)stat.n_bytes/n << endl;
+    cout << "escapes/frame:      " << (double)stat.n_escapes/n << endl;
+    cout << "syscalls/frame:     " << (double)stat.n_writes/n << endl;
+    cout << "frame time p50:     " << p50 << " us" << endl;
+    cout << "frame time p99:     " << p99 << " us" << endl;
+    cout << "frame time mean:    " << mean << " us" << endl;
+    return 0;
+}
@@ -0,0 +1,329 @@
+// renderer.cpp
+//
+// This file contains the frame buffer for the terminal output.
+// The drawing macros append bytes to the frame, and nothing reaches the terminal
+// until the frame is flushed. So one frame costs exactly one write() in the usual case.
+//
+
+#include "renderer.hpp"
+#include "format_macro.hpp"
+#include "prof.hpp"
+
+#include <cstring>
+#include <cerrno>
+#include <unistd.h> // write
+
+using namespace std;
+
+// ================================================================================= //
+// two-digit lookup table for the integer-to-ASCII conversion.
+// the characters of the number n (0 <= n < 100) are at 2*n and 2*n+1.
+// ================================================================================= //
+static const char DIGITS_2[] =
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// ================================================================================= //
+// SGR sequences (without the leading ESC) indexed by the color index.
+// the indices without a color fall back to the default.
+//
+// color index:
+//   0: none
+//   1: red       11: bright red
+//   2: green     12: bright green
+//   3: yellow    13: bright yellow
+//   4: blue      14: bright blue
+//   5: magenta   15: bright magenta
+//   6: cyan      16: bright cyan
+//   7: white     17: bright white
+//   8: black     18: bright black
+// ================================================================================= //
+struct SGR_ENTRY
+{
+    const char* seq;
+    size_t len;
+};
+#define SGR(code) {code, sizeof(code)-1}
+static const SGR_ENTRY SGR_TABLE[] = {
+    SGR(CLR_DEF), SGR(RED), SGR(GREEN), SGR(YELLOW), SGR(BLUE),
+    SGR(MAGENTA), SGR(CYAN), SGR(WHITE), SGR(BLACK), SGR(CLR_DEF),
+    SGR(CLR_DEF), SGR(BRED), SGR(BGREEN), SGR(BYELLOW), SGR(BBLUE),
+    SGR(BMAGENTA), SGR(BCYAN), SGR(BWHITE), SGR(BBLACK), SGR(CLR_DEF)
+};
+#undef SGR
+static const int N_SGR = sizeof(SGR_TABLE)/sizeof(SGR_TABLE[0]);
+
+// ================================================================================= //
+// the frame shared by all drawing macros.
+// ================================================================================= //
+RENDERER RENDERER::frame;
+
+// ================================================================================= //
+// Constructor
+//
+// The frame is empty and goes to the standard output.
+// The color on the terminal is unknown yet.
+// ================================================================================= //
+RENDERER::RENDERER(): len(0), fd(STDOUT_FILENO), cur_color(-1), f_count_escapes(false)
+{
+    resetStat();
+}
+
+// ================================================================================= //
+// append
+//
+// It copies the given bytes at the end of the frame.
+// If the frame is about to overflow, the current contents are flushed first.
+// A chunk larger than the whole buffer is written directly.
+// ================================================================================= //
+void RENDERER::append(const char* s, size_t n)
+{
+    if(len + n > BUFF_SIZE)
+    {
+        flush();
+        if(n > BUFF_SIZE)
+        {
+            write_all(s, n);
+            return;
+        }
+    }
+    memcpy(buff + len, s, n);
+    len += n;
+}
+
+// ================================================================================= //
+// operator<<
+//
+// They append a character, a string, or an integer to the frame.
+// ================================================================================= //
+RENDERER& RENDERER::operator<<(char c)
+{
+    if(len == BUFF_SIZE)
+        flush();
+    buff[len++] = c;
+    return *this;
+}
+
+RENDERER& RENDERER::operator<<(const char* s)
+{
+    append(s, strlen(s));
+    return *this;
+}
+
+RENDERER& RENDERER::operator<<(const string& s)
+{
+    append(s.data(), s.size());
+    return *this;
+}
+
+RENDERER& RENDERER::operator<<(int v)
+{
+    if(v < 0)
+    {
+        *this << '-';
+        put_uint(0u - (unsigned int)v);
+    }
+    else
+    {
+        put_uint(v);
+    }
+    return *this;
+}
+
+// ================================================================================= //
+// put_uint
+//
+// It appends the decimal digits of the given number without any heap or locale.
+// The numbers below 1000 (i.e., every position on a terminal) take at most
+// two lookups in the two-digit table.
+// ================================================================================= //
+void RENDERER::put_uint(unsigned int v)
+{
+    if(len + 10 > BUFF_SIZE)
+        flush();
+
+    char* p = buff + len;
+    if(v < 10)
+    {
+        *p++ = '0' + v;
+    }
+    else if(v < 100)
+    {
+        *p++ = DIGITS_2[2*v];
+        *p++ = DIGITS_2[2*v+1];
+    }
+    else if(v < 1000)
+    {
+        *p++ = '0' + v / 100;
+        v %= 100;
+        *p++ = DIGITS_2[2*v];
+        *p++ = DIGITS_2[2*v+1];
+    }
+    else
+    {
+        char digits[10];
+        int n = sizeof(digits);
+        while(v >= 100)
+        {
+            unsigned int r = v % 100;
+            v /= 100;
+            digits[--n] = DIGITS_2[2*r+1];
+            digits[--n] = DIGITS_2[2*r];
+        }
+        if(v >= 10)
+        {
+            digits[--n] = DIGITS_2[2*v+1];
+            digits[--n] = DIGITS_2[2*v];
+        }
+        else
+        {
+            digits[--n] = '0' + v;
+        }
+        memcpy(p, digits + n, sizeof(digits) - n);
+        p += sizeof(digits) - n;
+    }
+    len = p - buff;
+}
+
+// ================================================================================= //
+// move_cursor
+//
+// It appends the escape sequence to move the cursor, i.e., ESC [ y ; x H.
+// note: the position is specified by 1-index (it starts with 1, not 0)
+// ================================================================================= //
+void RENDERER::move_cursor(int x, int y)
+{
+    if(len + 2 > BUFF_SIZE)
+        flush();
+    buff[len++] = '\x1B';
+    buff[len++] = '[';
+    put_uint(y);
+    *this << ';';
+    put_uint(x);
+    *this << 'H';
+}
+
+// ================================================================================= //
+// set_color
+//
+// It changes the color of characters.
+// The terminal keeps the color once it is set,
+// so the escape sequence is appended only if the color actually changes.
+// ================================================================================= //
+void RENDERER::set_color(int clr)
+{
+    if(clr < 0 || N_SGR <= clr)
+        clr = 0;
+    if(clr == cur_color)
+        return;
+    *this << ESC;
+    append(SGR_TABLE[clr].seq, SGR_TABLE[clr].len);
+    cur_color = clr;
+}
+
+// ================================================================================= //
+// put_n
+//
+// It appends the given character n times.
+// ================================================================================= //
+void RENDERER::put_n(char c, int n)
+{
+    while(n > 0)
+    {
+        if(len == BUFF_SIZE)
+            flush();
+        size_t n_put = BUFF_SIZE - len;
+        if(n_put > (size_t)n)
+            n_put = n;
+        memset(buff + len, c, n_put);
+        len += n_put;
+        n -= n_put;
+    }
+}
+
+// ================================================================================= //
+// flush
+//
+// It sends the whole frame to the terminal by one write() call.
+// (more calls are made only if the kernel accepts a part of the frame.)
+// Then, the frame is emptied.
+// ================================================================================= //
+void RENDERER::flush()
+{
+    if(len == 0)
+        return;
+    PROF_SCOPE(flush);
+    stat.n_frames++;
+    write_all(buff, len);
+    len = 0;
+}
+
+// ================================================================================= //
+// write_all
+//
+// It writes the given bytes, retrying on a partial write or an interruption,
+// and counts what is sent.
+// ================================================================================= //
+void RENDERER::write_all(const char* s, size_t n)
+{
+    if(f_count_escapes)
+    {
+        for(size_t i = 0; i < n; i++)
+            if(s[i] == '\x1B')
+                stat.n_escapes++;
+    }
+    while(n > 0)
+    {
+        ssize_t n_written = write(fd, s, n);
+        stat.n_writes++;
+        if(n_written < 0)
+        {
+            if(errno == EINTR)
+                continue;
+            break;
+        }
+        stat.n_bytes += n_written;
+        s += n_written;
+        n -= n_written;
+    }
+}
+
+// ================================================================================= //
+// setFd
+//
+// It sends the following frames to another file descriptor
+// (e.g., /dev/null or a pipe in a benchmark). The frame is flushed before.
+// ================================================================================= //
+void RENDERER::setFd(int fd)
+{
+    flush();
+    this->fd = fd;
+    cur_color = -1;
+}
+
+// ================================================================================= //
+// setCountEscapes / resetStat
+//
+// Counting the escape sequences looks at every byte sent,
+// so it is off unless someone asks for it.
+// ================================================================================= //
+void RENDERER::setCountEscapes(bool on)
+{
+    f_count_escapes = on;
+}
+
+void RENDERER::resetStat()
+{
+    stat.n_bytes = 0;
+    stat.n_writes = 0;
+    stat.n_frames = 0;
+    stat.n_escapes = 0;
+}
@@ -0,0 +1,73 @@
+// renderer.hpp
+//
+// A frame buffer for the terminal output.
+// Everything drawn in a frame is composed into a single preallocated buffer,
+// and it is sent to the terminal by one write() call when the frame is flushed.
+//
+
+#ifndef _RENDERER_HPP
+#define _RENDERER_HPP
+
+#include <cstddef>
+#include <string>
+
+// counters of the output sent by a frame buffer
+struct RENDER_STAT
+{
+    // # of bytes written, # of write() calls, # of frames flushed
+    unsigned long long n_bytes;
+    unsigned long long n_writes;
+    unsigned long long n_frames;
+    // # of escape sequences (counted only if enabled; see RENDERER::setCountEscapes)
+    unsigned long long n_escapes;
+};
+
+class RENDERER
+{
+private:
+    // the size of the frame buffer in bytes
+    // (a full redraw of the default screen fits in it)
+    static const size_t BUFF_SIZE = 1 << 16;
+
+    // the frame buffer and the number of bytes stored in it
+    char buff[BUFF_SIZE];
+    size_t len;
+
+    // the file descriptor where frames go
+    int fd;
+
+    // the color index currently set on the terminal
+    // (-1 if it is unknown, e.g., nothing has been sent yet)
+    int cur_color;
+
+    // counters of the output, and whether the escape sequences are counted
+    RENDER_STAT stat;
+    bool f_count_escapes;
+
+    void append(const char* s, size_t n);
+    void write_all(const char* s, size_t n);
+    void put_uint(unsigned int v);
+
+public:
+    // the frame shared by all drawing macros
+    static RENDERER frame;
+
+    RENDERER();
+
+    RENDERER& operator<<(char c);
+    RENDERER& operator<<(const char* s);
+    RENDERER& operator<<(const std::string& s);
+    RENDERER& operator<<(int v);
+
+    void move_cursor(int x, int y);
+    void set_color(int clr);
+    void put_n(char c, int n);
+    void flush();
+
+    void setFd(int fd);
+    void setCountEscapes(bool on);
+    void resetStat();
+    const RENDER_STAT& getStat() const { return stat; }
+};
+
+#endif //_RENDERER_HPP
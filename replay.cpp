@@ -0,0 +1,191 @@
+// replay.cpp
+//
+// This file contains the writer and the reader of replay files.
+// See replay.hpp for the format.
+//
+
+#include "replay.hpp"
+#include <string.h> // memcmp
+
+static const char REPLAY_MAGIC[4] = {'W', 'R', 'P', 'L'};
+
+// ================================================================================= //
+// put_u32 / get_u32
+//
+// little-endian 32-bit integers in the header
+// ================================================================================= //
+static void put_u32(uint8_t *p, uint32_t v)
+{
+    p[0] = v & 0xFF;
+    p[1] = (v >> 8) & 0xFF;
+    p[2] = (v >> 16) & 0xFF;
+    p[3] = (v >> 24) & 0xFF;
+}
+
+static uint32_t get_u32(const uint8_t *p)
+{
+    return (uint32_t)p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24);
+}
+
+// ================================================================================= //
+// REPLAY_WRITER
+// ================================================================================= //
+REPLAY_WRITER::REPLAY_WRITER(): fp(NULL), t_last(0)
+{
+}
+
+REPLAY_WRITER::~REPLAY_WRITER()
+{
+    close();
+}
+
+// ================================================================================= //
+// open
+//
+// It creates the file and writes the header.
+// It returns false if the file cannot be written.
+// ================================================================================= //
+bool REPLAY_WRITER::open(const char *path, const REPLAY_HEADER &header)
+{
+    close();
+    fp = fopen(path, "wb");
+    if(fp == NULL)
+        return false;
+
+    uint8_t buff[12];
+    memcpy(buff, REPLAY_MAGIC, 4);
+    buff[4] = REPLAY_VERSION;
+    buff[5] = header.nrow;
+    buff[6] = header.ncol;
+    buff[7] = header.flags;
+    put_u32(buff + 8, header.seed);
+    if(fwrite(buff, sizeof(buff), 1, fp) != 1)
+    {
+        close();
+        return false;
+    }
+    t_last = 0;
+    return true;
+}
+
+// ================================================================================= //
+// record
+//
+// It appends an action taken at t_ms milliseconds from the start.
+// The time never goes back, so only the difference from the last record is stored.
+// ================================================================================= //
+void REPLAY_WRITER::record(ACTION act, uint32_t t_ms)
+{
+    if(fp == NULL)
+        return;
+    uint32_t dt = (t_ms > t_last)? t_ms - t_last: 0;
+    t_last += dt;
+
+    uint64_t v = ((uint64_t)dt << 3) | (act & 7);
+    uint8_t buff[10];
+    int len = 0;
+    do
+    {
+        uint8_t b = v & 0x7F;
+        v >>= 7;
+        buff[len++] = b | ((v != 0)? 0x80: 0);
+    } while(v != 0);
+    fwrite(buff, len, 1, fp);
+}
+
+void REPLAY_WRITER::close()
+{
+    if(fp != NULL)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+}
+
+// ================================================================================= //
+// REPLAY_READER
+// ================================================================================= //
+REPLAY_READER::REPLAY_READER(): fp(NULL), t_last(0)
+{
+    header.nrow = header.ncol = header.flags = 0;
+    header.seed = 0;
+}
+
+REPLAY_READER::~REPLAY_READER()
+{
+    close();
+}
+
+// ================================================================================= //
+// open
+//
+// It opens the file and reads the header.
+// It returns false if the file cannot be read, it is not a replay of this version,
+// or its bin cannot be played (see ENGINE::isValidSize).
+// ================================================================================= //
+bool REPLAY_READER::open(const char *path)
+{
+    close();
+    fp = fopen(path, "rb");
+    if(fp == NULL)
+        return false;
+
+    uint8_t buff[12];
+    if(fread(buff, sizeof(buff), 1, fp) != 1
+        || memcmp(buff, REPLAY_MAGIC, 4) != 0 || buff[4] != REPLAY_VERSION)
+    {
+        close();
+        return false;
+    }
+    header.nrow = buff[5];
+    header.ncol = buff[6];
+    header.flags = buff[7];
+    header.seed = get_u32(buff + 8);
+    if(!ENGINE::isValidSize(header.nrow, header.ncol))
+    {
+        close();
+        return false;
+    }
+    t_last = 0;
+    return true;
+}
+
+// ================================================================================= //
+// next
+//
+// It reads the next action and the time it was taken (milliseconds from the start).
+// It returns false at the end of the file, or if the record is broken.
+// ================================================================================= //
+bool REPLAY_READER::next(ACTION &act, uint32_t &t_ms)
+{
+    if(fp == NULL)
+        return false;
+
+    uint64_t v = 0;
+    int shift = 0;
+    int c;
+    do
+    {
+        c = getc(fp);
+        if(c == EOF || shift > 35)
+            return false;
+        v |= (uint64_t)(c & 0x7F) << shift;
+        shift += 7;
+    } while(c & 0x80);
+
+    if((v & 7) >= N_ACTION)
+        return false;
+    act = (ACTION)(v & 7);
+    t_last += (uint32_t)(v >> 3);
+    t_ms = t_last;
+    return true;
+}
+
+void REPLAY_READER::close()
+{
+    if(fp != NULL)
+    {
+        fclose(fp);
+        fp = NULL;
+    }
+}
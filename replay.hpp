@@ -0,0 +1,87 @@
+// replay.hpp
+//
+// Recording and playback of a game.
+// A game is fully decided by the seed of its engine and the actions given to it,
+// so a replay file holds only these: a small header with the seed,
+// and one record per action with the time it was taken.
+// Gravity steps are recorded as actions too, so a replay does not depend on any timer.
+//
+// file format (all integers are little-endian):
+//   header (12 bytes):
+//     "WRPL"       magic
+//     uint8_t      version (REPLAY_VERSION)
+//     uint8_t      # of rows of the bin
+//     uint8_t      # of columns of the bin
+//     uint8_t      flags (REPLAY_F_*)
+//     uint32_t     seed of the engine
+//   records, until the end of the file:
+//     varint       (dt << 3) | action
+//                  dt: milliseconds since the previous record
+//                  action: ACTION given to ENGINE::step (ACT_LEFT ... ACT_GRAVITY)
+//     a varint is 7 bits per byte from the lowest, and the top bit tells that more bytes follow.
+//     so most records take one or two bytes.
+//
+
+#ifndef _REPLAY_HPP
+#define _REPLAY_HPP
+
+#include <stdio.h>
+#include <stdint.h>
+#include "engine.hpp"
+
+#define REPLAY_VERSION 1
+// flags: the engine ran in the 7-bag mode
+#define REPLAY_F_BAG 1
+
+// the header of a replay
+struct REPLAY_HEADER
+{
+    int nrow;
+    int ncol;
+    int flags;
+    uint32_t seed;
+};
+
+class REPLAY_WRITER
+{
+private:
+    FILE *fp;
+    // the time of the last record in milliseconds
+    uint32_t t_last;
+
+    REPLAY_WRITER(const REPLAY_WRITER&);
+    REPLAY_WRITER& operator=(const REPLAY_WRITER&);
+
+public:
+    REPLAY_WRITER();
+    ~REPLAY_WRITER();
+
+    bool open(const char *path, const REPLAY_HEADER &header);
+    void record(ACTION act, uint32_t t_ms);
+    void close();
+    bool isOpen() const { return fp != NULL; }
+};
+
+class REPLAY_READER
+{
+private:
+    FILE *fp;
+    REPLAY_HEADER header;
+    // the time of the last record in milliseconds
+    uint32_t t_last;
+
+    REPLAY_READER(const REPLAY_READER&);
+    REPLAY_READER& operator=(const REPLAY_READER&);
+
+public:
+    REPLAY_READER();
+    ~REPLAY_READER();
+
+    bool open(const char *path);
+    bool next(ACTION &act, uint32_t &t_ms);
+    void close();
+    bool isOpen() const { return fp != NULL; }
+    const REPLAY_HEADER &getHeader() const { return header; }
+};
+
+#endif //_REPLAY_HPP
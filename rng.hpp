@@ -0,0 +1,70 @@
+// rng.hpp
+//
+// A small random number generator owned by each game (xoshiro128**).
+// Its state is four words, so a game carries its own sequence, and games in
+// different threads never share anything. The same seed always gives the same sequence.
+// A number in [0, n) is picked by a multiply and a shift, without any division.
+//
+
+#ifndef _RNG_HPP
+#define _RNG_HPP
+
+#include <stdint.h>
+
+class RNG
+{
+private:
+    uint32_t s[4];
+
+    static uint32_t rotl(uint32_t x, int k)
+    {
+        return (x << k) | (x >> (32 - k));
+    }
+
+    // splitmix64: spreads a seed over the whole state, so close seeds give unrelated sequences
+    static uint64_t splitmix64(uint64_t &x)
+    {
+        uint64_t z = (x += 0x9E3779B97F4A7C15ULL);
+        z = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+        z = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+        return z ^ (z >> 31);
+    }
+
+public:
+    explicit RNG(uint64_t seed = 1)
+    {
+        this->seed(seed);
+    }
+
+    void seed(uint64_t seed)
+    {
+        uint64_t a = splitmix64(seed);
+        uint64_t b = splitmix64(seed);
+        s[0] = (uint32_t)a;
+        s[1] = (uint32_t)(a >> 32);
+        s[2] = (uint32_t)b;
+        s[3] = (uint32_t)(b >> 32);
+    }
+
+    // the next 32 random bits
+    uint32_t next()
+    {
+        uint32_t result = rotl(s[1]*5, 7)*9;
+        uint32_t t = s[1] << 9;
+        s[2] ^= s[0];
+        s[3] ^= s[1];
+        s[1] ^= s[2];
+        s[0] ^= s[3];
+        s[2] ^= t;
+        s[3] = rotl(s[3], 11);
+        return result;
+    }
+
+    // a number in [0, n): the high word of next() * n
+    uint32_t below(uint32_t n)
+    {
+        return (uint32_t)(((uint64_t)next() * n) >> 32);
+    }
+};
+
+#endif //_RNG_HPP
@@ -0,0 +1,521 @@
+// sim.cpp
+//
+// This file contains the main function of wastedris-sim.
+// It plays many games without the terminal, in parallel on all cores,
+// and reports the throughput and the statistics of the games.
+// Each game has its own engine and its own seed, so nothing is shared between the games
+// and the same seed always plays the same game.
+//
+
+#include <iostream>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h> // sscanf
+#include <unistd.h> // getopt
+#include <time.h>
+#include <errno.h>
+#include "engine.hpp"
+#include "replay.hpp"
+
+using namespace std;
+
+// policies to drive the games
+enum POLICY
+{
+    POL_RANDOM = 0,   // drops each piece at a random rotation and column
+    POL_HEURISTIC     // drops each piece where the board looks best
+};
+
+// the options of the run
+struct SIM_OPTION
+{
+    int n_games;
+    int n_threads;
+    POLICY policy;
+    uint32_t seed;
+    int max_pieces;
+    bool f_bag;
+    int nrow, ncol;
+    // replay to write the first game to, replay to play instead, and its pace
+    const char *record_path;
+    const char *replay_path;
+    bool f_realtime;
+};
+
+// the times given to the actions of a recorded game:
+// gravity steps are apart as in the terminal game (ENGINE::getFallInterval),
+// and the player moves in between.
+#define SIM_MOVE_MS 50
+
+// the results gathered by a worker
+struct SIM_RESULT
+{
+    long long n_games;
+    long long n_pieces;
+    long long n_rows;
+    long long count_by_rows[NROW_PIECE+1];
+
+    SIM_RESULT(): n_games(0), n_pieces(0), n_rows(0)
+    {
+        for(int k = 0; k <= NROW_PIECE; k++)
+            count_by_rows[k] = 0;
+    }
+};
+
+// ================================================================================= //
+// WORK_POOL
+//
+// A work-stealing pool of game indices.
+// Each worker takes the games from the front of its own queue.
+// When its queue runs dry, it steals from the back of the others,
+// so the workers which got short games help the ones which got long games.
+// ================================================================================= //
+class WORK_POOL
+{
+private:
+    struct QUEUE
+    {
+        mutex mtx;
+        deque<int> games;
+    };
+    vector<QUEUE*> queues;
+
+public:
+    // the games are dealt to the workers in turn
+    WORK_POOL(int n_workers, int n_games)
+    {
+        for(int w = 0; w < n_workers; w++)
+            queues.push_back(new QUEUE);
+        for(int g = 0; g < n_games; g++)
+            queues[g % n_workers]->games.push_back(g);
+    }
+    ~WORK_POOL()
+    {
+        for(size_t w = 0; w < queues.size(); w++)
+            delete queues[w];
+    }
+
+    // it returns false if there is no game left anywhere
+    bool take(int w, int &game)
+    {
+        {
+            QUEUE *q = queues[w];
+            lock_guard<mutex> lock(q->mtx);
+            if(!q->games.empty())
+            {
+                game = q->games.front();
+                q->games.pop_front();
+                return true;
+            }
+        }
+        int n = queues.size();
+        for(int i = 1; i < n; i++)
+        {
+            QUEUE *q = queues[(w + i) % n];
+            lock_guard<mutex> lock(q->mtx);
+            if(!q->games.empty())
+            {
+                game = q->games.back();
+                q->games.pop_back();
+                return true;
+            }
+        }
+        return false;
+    }
+};
+
+// ================================================================================= //
+// landing_y
+//
+// It returns the row where the piece lands when it is dropped straight from y,
+// or -1*NROW_PIECE - 1 if the piece does not fit at y.
+// ================================================================================= //
+static int landing_y(const BOARD &board, PIECE_MASK mask, int x, int y)
+{
+    if(board.collides(mask, x, y))
+        return -1*NROW_PIECE - 1;
+    while(!board.collides(mask, x, y + 1))
+        y++;
+    return y;
+}
+
+// ================================================================================= //
+// evaluate
+//
+// It scores the board after the piece is dropped at (x, y). (the higher, the better)
+// The weights are the well-known ones of aggregate height, cleared rows, holes,
+// and bumpiness.
+// The drop is tried on board, a scratch copy of orig of the same size,
+// so no memory is allocated for each candidate.
+// ================================================================================= //
+static double evaluate(const BOARD &orig, BOARD &board, PIECE_MASK mask, int x, int y)
+{
+    board = orig;
+    board.place(mask, x, y);
+
+    int nrow = board.getNRow();
+    int ncol = board.getNCol();
+
+    // remove the full rows in one pass from the bottom
+    int n_cleared = 0;
+    for(int src = nrow - 1; src >= 0; src--)
+    {
+        if(board.isFull(src))
+            n_cleared++;
+        else if(n_cleared > 0)
+            board.moveRow(src, src + n_cleared);
+    }
+    for(int dst = n_cleared - 1; dst >= 0; dst--)
+        board.clearRow(dst);
+
+    // column heights and holes
+    int heights[64];
+    int holes = 0;
+    uint64_t seen = 0;
+    for(int c = 0; c < ncol; c++)
+        heights[c] = 0;
+    for(int r = 0; r < nrow; r++)
+    {
+        uint64_t bits = board.row(r);
+        uint64_t first = bits & ~seen;
+        for(int c = 0; c < ncol; c++)
+            if((first >> c) & 1)
+                heights[c] = nrow - r;
+        holes += __builtin_popcountll(seen & ~bits);
+        seen |= bits;
+    }
+
+    int agg_height = 0;
+    int bumpiness = 0;
+    for(int c = 0; c < ncol; c++)
+    {
+        agg_height += heights[c];
+        if(c > 0)
+            bumpiness += abs(heights[c] - heights[c-1]);
+    }
+
+    double score = -0.510066*agg_height + 0.760666*n_cleared - 0.35663*holes - 0.184483*bumpiness;
+    // a piece which stays above the bin ends the game
+    if(y < 0)
+        score -= 1000.0;
+    return score;
+}
+
+// ================================================================================= //
+// choose
+//
+// It picks the rotation and the column to drop the current piece at.
+// scratch is a board of the same size to try the drops on.
+// ================================================================================= //
+static void choose(const ENGINE &engine, POLICY policy, RNG &rng, BOARD &scratch, int &rot, int &x)
+{
+    int ncol = engine.getNCol();
+    int shape = engine.getCurShape();
+
+    if(policy == POL_RANDOM)
+    {
+        rot = rng.below(N_ROT);
+        x = (int)rng.below(ncol + NCOL_PIECE - 1) - (NCOL_PIECE - 1);
+        return;
+    }
+
+    const BOARD &board = engine.getBoard();
+    int y0 = engine.getCurY();
+    double best = -1e30;
+    rot = engine.getCurRot();
+    x = engine.getCurX();
+    for(int r = 0; r < N_ROT; r++)
+    {
+        PIECE_MASK mask = PIECE_TABLE[shape][r];
+        for(int cx = -(NCOL_PIECE - 1); cx < ncol; cx++)
+        {
+            int y = landing_y(board, mask, cx, y0);
+            if(y < -1*NROW_PIECE)
+                continue;
+            double score = evaluate(board, scratch, mask, cx, y);
+            if(score > best)
+            {
+                best = score;
+                rot = r;
+                x = cx;
+            }
+        }
+    }
+}
+
+// ================================================================================= //
+// take_action
+//
+// It gives an action to the engine, and records it if the game is recorded.
+// t_ms is the virtual clock of the game.
+// ================================================================================= //
+static int take_action(ENGINE &engine, REPLAY_WRITER *rec, uint32_t &t_ms, ACTION act)
+{
+    t_ms += (act == ACT_GRAVITY)? engine.getFallInterval(): SIM_MOVE_MS;
+    if(rec != NULL)
+        rec->record(act, t_ms);
+    return engine.step(act);
+}
+
+// ================================================================================= //
+// play_one
+//
+// It plays one game to the end (or up to max_pieces pieces) and adds up its results.
+// The piece is turned and moved by the same actions as the player's,
+// then it falls by gravity until it is locked.
+// If rec is not NULL, the game is written to it.
+// ================================================================================= //
+static void play_one(ENGINE &engine, BOARD &scratch, POLICY policy, uint32_t seed, int max_pieces,
+    SIM_RESULT &res, REPLAY_WRITER *rec)
+{
+    engine.seed(seed);
+    engine.init_stat();
+    RNG rng(((uint64_t)seed << 32) | 0x9E3779B9u);
+    uint32_t t_ms = 0;
+
+    while(engine.isRunning() && engine.getCountPieces() < max_pieces)
+    {
+        int rot, x;
+        choose(engine, policy, rng, scratch, rot, x);
+
+        for(int i = 0; i < N_ROT && engine.getCurRot() != rot; i++)
+            if(take_action(engine, rec, t_ms, ACT_ROT_R) == 0)
+                break;
+        while(engine.getCurX() > x && take_action(engine, rec, t_ms, ACT_LEFT) != 0)
+            ;
+        while(engine.getCurX() < x && take_action(engine, rec, t_ms, ACT_RIGHT) != 0)
+            ;
+        while((take_action(engine, rec, t_ms, ACT_GRAVITY) & (EV_LOCKED | EV_OVER)) == 0)
+            ;
+    }
+
+    res.n_games++;
+    res.n_pieces += engine.getCountPieces();
+    for(int k = 1; k <= NROW_PIECE; k++)
+    {
+        res.count_by_rows[k] += engine.getCountByRows(k);
+        res.n_rows += (long long)k*engine.getCountByRows(k);
+    }
+}
+
+// ================================================================================= //
+// worker
+// ================================================================================= //
+static void worker(int w, WORK_POOL *pool, const SIM_OPTION *opt, SIM_RESULT *res)
+{
+    ENGINE engine(opt->nrow, opt->ncol, opt->seed);
+    engine.setBag(opt->f_bag);
+    // the heuristic tries the drops on this board
+    BOARD scratch(opt->nrow, opt->ncol);
+    int game;
+    while(pool->take(w, game))
+    {
+        // only the first game is recorded
+        REPLAY_WRITER rec;
+        if(game == 0 && opt->record_path != NULL)
+        {
+            REPLAY_HEADER header;
+            header.nrow = opt->nrow;
+            header.ncol = opt->ncol;
+            header.flags = opt->f_bag? REPLAY_F_BAG: 0;
+            header.seed = opt->seed + game;
+            if(!rec.open(opt->record_path, header))
+                cerr << "cannot write the replay: " << opt->record_path << endl;
+        }
+        play_one(engine, scratch, opt->policy, opt->seed + game, opt->max_pieces, *res,
+            rec.isOpen()? &rec: NULL);
+    }
+}
+
+// ================================================================================= //
+// replay
+//
+// It plays a replay file on an engine without the terminal,
+// as fast as possible, or at the recorded pace if f_realtime is true.
+// It prints the result and a checksum of the final bin,
+// so two runs of the same replay can be compared.
+// ================================================================================= //
+static int replay(const char *path, bool f_realtime)
+{
+    REPLAY_READER reader;
+    if(!reader.open(path))
+    {
+        cerr << "cannot read the replay: " << path << endl;
+        return 1;
+    }
+    const REPLAY_HEADER &header = reader.getHeader();
+    ENGINE engine(header.nrow, header.ncol, header.seed);
+    engine.setBag((header.flags & REPLAY_F_BAG) != 0);
+    engine.init_stat();
+
+    struct timespec t_origin;
+    clock_gettime(CLOCK_MONOTONIC, &t_origin);
+    chrono::steady_clock::time_point t_begin = chrono::steady_clock::now();
+
+    long long n_actions = 0;
+    ACTION act;
+    uint32_t t_ms;
+    while(engine.isRunning() && reader.next(act, t_ms))
+    {
+        if(f_realtime)
+        {
+            struct timespec t_wake = t_origin;
+            t_wake.tv_sec += t_ms / 1000;
+            t_wake.tv_nsec += (t_ms % 1000) * 1000000L;
+            if(t_wake.tv_nsec >= 1000000000L)
+            {
+                t_wake.tv_sec++;
+                t_wake.tv_nsec -= 1000000000L;
+            }
+            while(clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &t_wake, NULL) == EINTR)
+                ;
+        }
+        engine.step(act);
+        n_actions++;
+    }
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t_begin).count();
+
+    // FNV-1a over the bin and the current piece
+    uint32_t hash = 2166136261u;
+    const uint8_t *bin = engine.getBin();
+    for(int i = 0; i < header.nrow*header.ncol; i++)
+        hash = (hash ^ bin[i]) * 16777619u;
+    int state[4] = {engine.getCurShape(), engine.getCurRot(), engine.getCurX(), engine.getCurY()};
+    for(int i = 0; i < 4; i++)
+        hash = (hash ^ (uint32_t)state[i]) * 16777619u;
+
+    cout << "replay:        " << path << endl;
+    cout << "seed:          " << header.seed << endl;
+    cout << "actions:       " << n_actions << endl;
+    cout << "pieces:        " << engine.getCountPieces() << endl;
+    cout << "rows cleared:  " << engine.getCountClearingRows() << " clearings" << endl;
+    cout << "game over:     " << (engine.isRunning()? "no": "yes") << endl;
+    cout << "time:          " << sec << " s" << endl;
+    if(!f_realtime && sec > 0)
+        cout << "actions/sec:   " << n_actions/sec << endl;
+    cout << "checksum:      " << hex << hash << dec << endl;
+    return 0;
+}
+
+static void usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [-n games] [-j threads] [-p random|heuristic] [-s seed] [-m max_pieces] [-b] [-d ROWSxCOLS] [-w replay_to_write]" << endl;
+    cerr << "       " << prog << " -r replay_to_play [-t]" << endl;
+}
+
+// ============================================================================== //
+// main
+//
+// Description:
+//   It parses the options, runs the games on the workers,
+//   and prints the throughput and the line-clear statistics.
+//   The game i is played with the seed (seed + i), whichever worker plays it.
+//   With -d, the games are played in a bin of the given size instead of 13x11.
+//   With -w, the game 0 is also written to a replay file.
+//   With -r, it plays a replay file instead (with -t, at the recorded pace).
+//
+// ============================================================================== //
+int main(int argc, char **argv)
+{
+    SIM_OPTION opt;
+    opt.n_games = 1000;
+    opt.n_threads = thread::hardware_concurrency();
+    opt.policy = POL_RANDOM;
+    opt.seed = 1;
+    opt.max_pieces = 10000;
+    opt.f_bag = false;
+    opt.record_path = NULL;
+    opt.replay_path = NULL;
+    opt.f_realtime = false;
+    opt.nrow = NROW_BIN;
+    opt.ncol = NCOL_BIN;
+    if(opt.n_threads <= 0)
+        opt.n_threads = 1;
+
+    int c;
+    while((c = getopt(argc, argv, "n:j:p:s:m:bd:w:r:th")) != -1)
+    {
+        switch(c)
+        {
+        case 'n': opt.n_games = atoi(optarg); break;
+        case 'j': opt.n_threads = atoi(optarg); break;
+        case 's': opt.seed = strtoul(optarg, NULL, 0); break;
+        case 'm': opt.max_pieces = atoi(optarg); break;
+        case 'b': opt.f_bag = true; break;
+        case 'd':
+            if(sscanf(optarg, "%dx%d", &opt.nrow, &opt.ncol) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'w': opt.record_path = optarg; break;
+        case 'r': opt.replay_path = optarg; break;
+        case 't': opt.f_realtime = true; break;
+        case 'p':
+            if(strcmp(optarg, "random") == 0)
+                opt.policy = POL_RANDOM;
+            else if(strcmp(optarg, "heuristic") == 0)
+                opt.policy = POL_HEURISTIC;
+            else
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(opt.replay_path != NULL)
+        return replay(opt.replay_path, opt.f_realtime);
+    if(opt.n_games <= 0 || opt.n_threads <= 0 || opt.max_pieces <= 0
+        || !ENGINE::isValidSize(opt.nrow, opt.ncol))
+    {
+        usage(argv[0]);
+        return 1;
+    }
+
+    WORK_POOL pool(opt.n_threads, opt.n_games);
+    vector<SIM_RESULT> results(opt.n_threads);
+    vector<thread> threads;
+
+    chrono::steady_clock::time_point t_start = chrono::steady_clock::now();
+    for(int w = 0; w < opt.n_threads; w++)
+        threads.push_back(thread(worker, w, &pool, &opt, &results[w]));
+    for(int w = 0; w < opt.n_threads; w++)
+        threads[w].join();
+    double sec = chrono::duration<double>(chrono::steady_clock::now() - t_start).count();
+
+    SIM_RESULT total;
+    for(int w = 0; w < opt.n_threads; w++)
+    {
+        total.n_games += results[w].n_games;
+        total.n_pieces += results[w].n_pieces;
+        total.n_rows += results[w].n_rows;
+        for(int k = 0; k <= NROW_PIECE; k++)
+            total.count_by_rows[k] += results[w].count_by_rows[k];
+    }
+
+    cout << "policy:        " << (opt.policy == POL_RANDOM? "random": "heuristic") << endl;
+    cout << "randomizer:    " << (opt.f_bag? "7-bag": "uniform") << endl;
+    cout << "threads:       " << opt.n_threads << endl;
+    cout << "games:         " << total.n_games << endl;
+    cout << "pieces:        " << total.n_pieces << endl;
+    cout << "time:          " << sec << " s" << endl;
+    cout << "games/sec:     " << total.n_games/sec << endl;
+    cout << "pieces/sec:    " << total.n_pieces/sec << endl;
+    cout << "rows cleared:  " << total.n_rows
+         << " (" << (double)total.n_rows/total.n_games << " per game)" << endl;
+    for(int k = 1; k <= NROW_PIECE; k++)
+        cout << "  " << k << "-row clears: " << total.count_by_rows[k] << endl;
+
+    return 0;
+}
@@ -0,0 +1,519 @@
+// view.cpp
+//
+// This file contains the drawing of a game.
+// The state comes from the engine, and everything is drawn into the frame.
+// Nothing reaches the terminal until the caller flushes the frame.
+//
+
+#include "view.hpp"
+#include "format_macro.hpp"
+#include "prof.hpp"
+
+#include <stdint.h>
+#include <stdlib.h> // posix_memalign
+#include <string.h> // memcpy, memset
+#include <new> // bad_alloc
+
+using namespace std;
+
+// ================================================================================= //
+// Constructor
+//
+// It sets up the layout of the screen for the engine's bin and the size of a cell
+// (wcell x hcell characters), and allocates the planes remembering what is on the screen.
+// Nothing is drawn here.
+// note: a cell must be at least 2 x 1 characters.
+//       a cell of a single line is drawn compact like "[]" (see PUT_CELL_SPAN_COLOR_AT).
+// ================================================================================= //
+VIEW::VIEW(const ENGINE *engine, int wcell, int hcell):
+    engine(engine), wcell(wcell), hcell(hcell), wcell_req(wcell), hcell_req(hcell),
+    movie_row(0), movie_rng(ENDMOVIE_SEED)
+{
+    nrow = engine->getNRow();
+    ncol = engine->getNCol();
+
+    layout();
+
+    // the two planes share one allocation aligned to the cache line
+    size_t plane_size = (nrow*ncol + CACHE_LINE - 1) / CACHE_LINE * CACHE_LINE;
+    void *block = NULL;
+    if(posix_memalign(&block, CACHE_LINE, 2*plane_size) != 0)
+        throw bad_alloc();
+    planes = (uint8_t*)block;
+    canvas = planes;
+    shadow = planes + plane_size;
+
+    // what is on the screen is unknown until draw_background
+    invalidate(false);
+}
+
+// ================================================================================= //
+// Destructor
+// ================================================================================= //
+VIEW::~VIEW()
+{
+    free(planes);
+}
+
+// ================================================================================= //
+// layout
+//
+// It places the bin, the next box and the message box on the screen.
+// The next box and the message box are on the right of the bin, and share their width.
+// They are wide enough for the messages even if the cells are narrow,
+// and the screen is tall enough for the message box even if the bin is short.
+// ================================================================================= //
+void VIEW::layout()
+{
+    bin_start_x = START_CELL_X;
+    bin_start_y = START_CELL_Y;
+
+    next_start_x = bin_start_x + ncol*wcell + 1 + 1;
+    next_start_y = bin_start_y;
+    next_width = NCOL_PIECE*wcell;
+    if(next_width < MESS_MIN_WIDTH)
+        next_width = MESS_MIN_WIDTH;
+    next_height = NROW_PIECE*hcell;
+    // the piece is in the middle of the next box
+    next_cell_x = next_start_x + (next_width - NCOL_PIECE*wcell)/2;
+
+    mess_start_x = next_start_x;
+    mess_start_y = next_start_y + next_height + 1 + 1;
+    mess_width = next_width;
+    mess_height = bin_start_y + nrow*hcell - mess_start_y;
+    if(mess_height < MESS_MIN_HEIGHT)
+        mess_height = MESS_MIN_HEIGHT;
+
+    screen_width = next_start_x + next_width + 1;
+    screen_height = mess_start_y + mess_height + 3;
+}
+
+// ================================================================================= //
+// reset
+//
+// It forgets the state drawn before, e.g., when a new game starts.
+// also it clears the message box.
+// the shadows are invalidated, so the next frame redraws all panels with the new state.
+// ================================================================================= //
+void VIEW::reset()
+{
+    memset(canvas, 0, nrow*ncol);
+
+    invalidate(false);
+    clear_message();
+}
+
+// ================================================================================= //
+// start_endmovie
+//
+// It starts the end movie. The movie is drawn one frame at a time by draw_endmovie,
+// so the caller decides when each frame is shown, and can stop it at any time.
+// ================================================================================= //
+void VIEW::start_endmovie()
+{
+    movie_row = screen_height;
+}
+
+// ================================================================================= //
+// draw_endmovie
+//
+// It draws the next frame of the end movie.
+// A wave of symbols ('#', '*', ';', '.' and blank from the top) rises by one row
+// each frame, and the screen behind it is wiped out.
+// A row of the wave is composed in a line buffer, and drawn by a single cursor movement.
+// It returns false if the movie has ended (nothing is drawn then).
+// ================================================================================= //
+bool VIEW::draw_endmovie()
+{
+    if(movie_row < 1)
+        return false;
+
+    static const char symbols[5] = {' ', '.', ';', '*', '#'};
+    // % of the characters of the row left blank
+    static const int thresholds[5] = {0, 90, 30, 5, 0};
+    int width = screen_width;
+    int i = movie_row;
+
+    CHANGE_COLOR_BRED();
+    for(int isym = 0; isym < 5 && i - isym >= 1; isym++)
+    {
+        MOVE_CURSOR(1, i - isym);
+        if(thresholds[isym] == 0)
+        {
+            PUT_CHARS(symbols[isym], width);
+            continue;
+        }
+        movie_line.assign(width, symbols[isym]);
+        for(int icol = 0; icol < width; icol++)
+        {
+            if((int)movie_rng.below(100) < thresholds[isym])
+                movie_line[icol] = ' ';
+        }
+        FRAME << movie_line;
+    }
+    CHANGE_COLOR_DEF();
+    movie_row--;
+    return true;
+}
+
+// ================================================================================= //
+// finish_endmovie
+//
+// It draws the last frame of the end movie at once (e.g., when the movie is skipped).
+// The rows the wave has not passed yet are wiped out.
+// ================================================================================= //
+void VIEW::finish_endmovie()
+{
+    CHANGE_COLOR_DEF();
+    for(int i = 1; i <= movie_row; i++)
+    {
+        MOVE_CURSOR(1, i);
+        PUT_CHARS(' ', screen_width);
+    }
+    movie_row = 0;
+}
+
+// ================================================================================= //
+// mark_dirty
+//
+// It marks the panels affected by the events reported by the engine.
+// ================================================================================= //
+void VIEW::mark_dirty(int events)
+{
+    if(events & EV_MOVED)
+        dirty |= DIRTY_BIN;
+    if(events & EV_LOCKED)
+        dirty |= DIRTY_BIN | DIRTY_NEXT;
+    if(events & EV_CLEARED)
+        dirty |= DIRTY_BIN | DIRTY_MESS;
+}
+
+// ================================================================================= //
+// fit
+//
+// It lays out the screen again for a terminal of the given size (0: unknown).
+// The cells have the size asked for if the screen fits in the terminal.
+// Otherwise, they become compact (WCELL_COMPACT x HCELL_COMPACT).
+// It returns true if the layout has changed. Nothing is drawn here.
+// ================================================================================= //
+bool VIEW::fit(int term_width, int term_height)
+{
+    int old_wcell = wcell;
+    int old_hcell = hcell;
+
+    wcell = wcell_req;
+    hcell = hcell_req;
+    layout();
+    if(term_width > 0 && term_height > 0
+        && (screen_width > term_width || screen_height > term_height))
+    {
+        wcell = WCELL_COMPACT;
+        hcell = HCELL_COMPACT;
+        layout();
+    }
+    // every position follows from the size of the cells
+    return wcell != old_wcell || hcell != old_hcell;
+}
+
+// ================================================================================= //
+// draw_background
+//
+// This method draws the background including the bin and the next box.
+// Since the screen is cleared, all panels are blank afterwards.
+//
+// ================================================================================= //
+void VIEW::draw_background()
+{
+    CLEAR_SCREEN();
+    draw_boxes();
+    invalidate(true);
+}
+
+// ================================================================================= //
+// draw_boxes
+//
+// It draws the frames of the bin, the next box and the message box over the screen
+// as it is. (e.g., to repair them after the terminal was resized)
+// ================================================================================= //
+void VIEW::draw_boxes()
+{
+    CHANGE_COLOR_CYAN();
+    DRAW_RECT(bin_start_x-1, bin_start_y-1, bin_start_x+wcell*ncol, bin_start_y+hcell*nrow);
+    DRAW_RECT(next_start_x-1, next_start_y-1, next_start_x+next_width, next_start_y+next_height);
+    MOVE_CURSOR(next_start_x+next_width/2-2, next_start_y-1);
+    FRAME << "NEXT";
+    DRAW_RECT(mess_start_x-1, mess_start_y-1, mess_start_x+mess_width, mess_start_y+mess_height);
+    CHANGE_COLOR_DEF();
+}
+
+// ================================================================================= //
+// invalidate
+//
+// It resets the shadows of all panels and marks them as dirty.
+//
+// If blank is true, the panels are known to be empty on the screen
+// (e.g., just after the screen is cleared), so only non-empty cells are drawn next.
+// Otherwise, the screen is unknown, and everything is redrawn in the next frame.
+// ================================================================================= //
+void VIEW::invalidate(bool blank)
+{
+    uint8_t v = blank? 0: CLR_UNKNOWN;
+    memset(shadow, v, nrow*ncol);
+    memset(next_shadow, v, sizeof(next_shadow));
+    mess_shadow = blank? 0: -1;
+    dirty = DIRTY_ALL;
+}
+
+// ================================================================================= //
+// draw_bin
+//
+// It draws the cells of the bin which differ from the shadow (see draw_cells).
+//
+// NC, W and H are the # of columns and the size of a cell known at compile time
+// (0: given by the members at run time). With the constants, the loops over a row
+// and over the characters of a cell are specialized for the size.
+// ================================================================================= //
+template <int NC, int W, int H>
+void VIEW::draw_bin()
+{
+    const int nc = (NC > 0)? NC: ncol;
+    const int w = (W > 0)? W: wcell;
+    const int h = (H > 0)? H: hcell;
+    memcpy(canvas, engine->getBin(), nrow*nc);
+    PIECE_MASK cur_mask = PIECE_TABLE[engine->getCurShape()][engine->getCurRot()];
+    int cur_p_x = engine->getCurX();
+    int cur_p_y = engine->getCurY();
+    for(int i = 0; i < NCOL_PIECE; i++)
+    {
+        for(int j = 0; j < NROW_PIECE; j++)
+        {
+            if(PIECE_CELL(cur_mask,j,i))
+            {
+                if(0<=cur_p_x+i&&cur_p_x+i<nc&&0<=cur_p_y+j&&cur_p_y+j<nrow)
+                    canvas[(cur_p_y+j)*nc + cur_p_x+i] = engine->getCurColor();
+            }
+        }
+    }
+    for(int j = 0; j < nrow; j++)
+    {
+        const uint8_t *canvas_row = canvas + j*nc;
+        uint8_t *shadow_row = shadow + j*nc;
+        for(int i = 0; i < nc; i++)
+        {
+            if(canvas_row[i] != shadow_row[i])
+            {
+                // extend the span over the following cells in the same color,
+                // and drop the unchanged cells at its end.
+                int clr = canvas_row[i];
+                int i_end = i;
+                for(int k = i + 1; k < nc && canvas_row[k] == clr; k++)
+                {
+                    if(canvas_row[k] != shadow_row[k])
+                        i_end = k;
+                }
+                PUT_CELL_SPAN_COLOR_AT(bin_start_x,bin_start_y,w,h,i,i_end,j,clr);
+                for(int k = i; k <= i_end; k++)
+                    shadow_row[k] = clr;
+                i = i_end;
+            }
+        }
+    }
+}
+
+// ================================================================================= //
+// draw_cells
+//
+// It draws all cells in the bin and the next box.
+//
+// A panel not marked as dirty is skipped entirely.
+//
+// For each panel, it remembers which color is stored for each cell.
+// Only if a cell is to be changed in color, it draws the cell.
+//
+// To draw the bin, it first generates a table of color information for each cell.
+// Then, the table is compared with the old one.
+// Only if different, the cell is redrawn.
+// The next box is compared with its own shadow in the same way.
+// Adjacent cells in the same color on a row are drawn together as one span.
+// The color escapes are sent only when the color actually changes.
+//
+// The cells are only composed in the frame buffer.
+// The caller sends the frame to the terminal with FLUSH().
+//
+// color index:
+//   1: red       11: bright red
+//   2: green     12: bright green 
+//   3: yellow    13: bright yellow
+//   4: blue      14: bright blue
+//   5: magenta   15: bright magenta
+//   6: cyan      16: bright cyan
+//   7: white     17: bright white
+// ================================================================================= //
+void VIEW::draw_cells()
+{
+    PROF_SCOPE(draw);
+    if(dirty & DIRTY_BIN)
+    {
+        // the default layout, the common width and the compact cells have their own copies
+        if(ncol == NCOL_BIN && wcell == WCELL && hcell == HCELL)
+            draw_bin<NCOL_BIN, WCELL, HCELL>();
+        else if(ncol == 10 && wcell == WCELL && hcell == HCELL)
+            draw_bin<10, WCELL, HCELL>();
+        else if(ncol == NCOL_BIN && wcell == WCELL_COMPACT && hcell == HCELL_COMPACT)
+            draw_bin<NCOL_BIN, WCELL_COMPACT, HCELL_COMPACT>();
+        else
+            draw_bin<0, 0, 0>();
+    }
+    if(dirty & DIRTY_NEXT)
+    {
+        PIECE_MASK next_mask = PIECE_TABLE[engine->getNextShape()][engine->getNextRot()];
+        uint8_t next_canvas[NROW_PIECE][NCOL_PIECE];
+        for(int j = 0; j < NROW_PIECE; j++)
+            for(int i = 0; i < NCOL_PIECE; i++)
+                next_canvas[j][i] = PIECE_CELL(next_mask,j,i)? engine->getNextColor(): 0;
+        for(int j = 0; j < NROW_PIECE; j++)
+        {
+            for(int i = 0; i < NCOL_PIECE; i++)
+            {
+                if(next_canvas[j][i] != next_shadow[j][i])
+                {
+                    int clr = next_canvas[j][i];
+                    int i_end = i;
+                    for(int k = i + 1; k < NCOL_PIECE && next_canvas[j][k] == clr; k++)
+                    {
+                        if(next_canvas[j][k] != next_shadow[j][k])
+                            i_end = k;
+                    }
+                    PUT_CELL_SPAN_COLOR_AT(next_cell_x,next_start_y,wcell,hcell,i,i_end,j,clr);
+                    for(int k = i; k <= i_end; k++)
+                        next_shadow[j][k] = clr;
+                    i = i_end;
+                }
+            }
+        }
+    }
+    dirty &= ~(DIRTY_BIN | DIRTY_NEXT);
+}
+
+// ================================================================================= //
+// put_message()
+//
+// put a message in the message box
+//
+// The message depends only on the count of clearing rows.
+// So nothing is drawn unless the count differs from the one on the screen,
+// and only the lines which change are drawn.
+// ================================================================================= //
+void VIEW::put_message()
+{
+    if(!(dirty & DIRTY_MESS))
+        return;
+    dirty &= ~DIRTY_MESS;
+    int count_clearing_rows = engine->getCountClearingRows();
+    if(count_clearing_rows == mess_shadow)
+        return;
+
+    // the box is cleared if the shown message cannot be extended
+    if(mess_shadow < 0 || count_clearing_rows < mess_shadow)
+        clear_message();
+
+    CHANGE_COLOR_MAGENTA();
+    if(count_clearing_rows >= 1 && mess_shadow < 1)
+    {
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+1);
+        FRAME << "YOU WASTED";
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+2);
+        FRAME << "YOUR TIME";
+    }
+    if(count_clearing_rows == 2)
+    {
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+3);
+        FRAME << "AGAIN";
+    }
+    else if(count_clearing_rows > 2)
+    {
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+3);
+        FRAME << count_clearing_rows << " TIMES";
+    }
+    if(count_clearing_rows > 10 && mess_shadow <= 10)
+    {
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+5);
+        FRAME << "It's time";
+        MOVE_CURSOR(mess_start_x+1,mess_start_y+6);
+        FRAME << "to regret";
+    }
+    mess_shadow = count_clearing_rows;
+}
+
+// ================================================================================= //
+// clear_message
+//
+// It clears everything in the message box
+// ================================================================================= //
+void VIEW::clear_message()
+{
+    for(int y = mess_start_y; y < mess_start_y + mess_height; y++)
+    {
+        MOVE_CURSOR(mess_start_x,y);
+        PUT_CHARS(' ', mess_width);
+    }
+    mess_shadow = 0;
+}
+
+// ================================================================================= //
+// draw_game_over
+//
+// It draws the box telling the game is over in the middle of the screen.
+// ================================================================================= //
+void VIEW::draw_game_over()
+{
+    CHANGE_COLOR_BRED();
+    MOVE_CURSOR(screen_width/2-6,screen_height/2-2);
+    FRAME << "#############";
+    MOVE_CURSOR(screen_width/2-6,screen_height/2-1);
+    FRAME << "#           #";
+    MOVE_CURSOR(screen_width/2-6,screen_height/2);
+    FRAME << "# GAME OVER #";
+    MOVE_CURSOR(screen_width/2-6,screen_height/2+1);
+    FRAME << "#           #";
+    MOVE_CURSOR(screen_width/2-6,screen_height/2+2);
+    FRAME << "#############";
+    MOVE_CURSOR(screen_width/2-4,screen_height/2);
+    CHANGE_COLOR_DEF();
+}
+
+// ================================================================================= //
+// refresh_message
+//
+// It clears the message box and lets the next put_message draw the message again.
+// (e.g., after something else was shown in the box)
+// ================================================================================= //
+void VIEW::refresh_message()
+{
+    clear_message();
+    dirty |= DIRTY_MESS;
+}
+
+// ================================================================================= //
+// put_text
+//
+// It shows the given lines in the message box instead of the message.
+// The lines which do not fit are cut off.
+// ================================================================================= //
+void VIEW::put_text(const vector<string> &lines)
+{
+    CHANGE_COLOR_DEF();
+    for(int i = 0; i < mess_height; i++)
+    {
+        MOVE_CURSOR(mess_start_x,mess_start_y+i);
+        int n = 0;
+        if(i < (int)lines.size())
+        {
+            n = lines[i].size();
+            if(n > mess_width)
+                n = mess_width;
+            FRAME << lines[i].substr(0, n);
+        }
+        PUT_CHARS(' ', mess_width - n);
+    }
+}
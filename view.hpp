@@ -0,0 +1,125 @@
+// view.hpp
+//
+// The drawing of a game on the terminal.
+// A VIEW looks at an engine and draws its state into the frame (renderer.hpp).
+// It remembers what is on the screen, so that only the changes are drawn.
+// It does not read any input or run any timer, so it can be driven by anything
+// that steps an engine, e.g., the game loop or a benchmark.
+//
+
+#ifndef _VIEW_HPP
+#define _VIEW_HPP
+
+#include <stdint.h>
+#include <string>
+#include <vector>
+#include "format_macro.hpp"
+#include "engine.hpp"
+#include "rng.hpp"
+
+// the seed of the noise in the end movie
+#define ENDMOVIE_SEED 0x5EED
+// the time between the frames of the end movie in milliseconds
+#define ENDMOVIE_INTERVAL 60
+
+class VIEW
+{
+private:
+    // the engine to draw
+    const ENGINE *engine;
+
+    // the size of the entire screen
+    int screen_width;
+    int screen_height;
+
+    // the top-left corner of the box where cells appear
+    int bin_start_x;
+    int bin_start_y;
+
+    // # of rows and # of columns of the box in terms of cells
+    int nrow;
+    int ncol;
+
+    // the size of a cell in characters, and the size asked for
+    // (the cells become compact if the screen does not fit in the terminal)
+    int wcell;
+    int hcell;
+    int wcell_req;
+    int hcell_req;
+
+    // the top-left corner of the next box and the size
+    int next_start_x;
+    int next_start_y;
+    int next_width;
+    int next_height;
+    // the left end of the cells of the piece in the next box
+    int next_cell_x;
+
+    // the top-left corner of the message box and the size
+    int mess_start_x;
+    int mess_start_y;
+    int mess_width;
+    int mess_height;
+
+    // planes: one cache-line-aligned block holding the two planes below.
+    // each plane is nrow x ncol colors in row-major order (the cell (y, x) is at y*ncol + x),
+    // and it starts on its own cache line.
+    uint8_t *planes;
+    // canvas: a buffer holding color infor of the bin
+    uint8_t *canvas;
+    // shadow: a buffer holding color infor of the bin in the previous state
+    uint8_t *shadow;
+    // next_shadow: color info of the next box in the previous state
+    uint8_t next_shadow[NROW_PIECE][NCOL_PIECE];
+    // mess_shadow: count of clearing rows shown in the message box
+    int mess_shadow;
+
+    // dirty: flags of the panels which may differ from the screen
+    // (a clean panel is skipped without looking into its shadow)
+    enum
+    {
+        DIRTY_BIN = 1,
+        DIRTY_NEXT = 2,
+        DIRTY_MESS = 4,
+        DIRTY_ALL = DIRTY_BIN | DIRTY_NEXT | DIRTY_MESS
+    };
+    int dirty;
+
+    // the end movie: the row where the wave is (0: not playing),
+    // the generator of its noise, and a line of the wave
+    int movie_row;
+    RNG movie_rng;
+    std::string movie_line;
+
+    // a view owns its planes, so it is not copied by accident
+    VIEW(const VIEW&);
+    VIEW& operator=(const VIEW&);
+
+    void layout();
+    template <int NC, int W, int H> void draw_bin();
+
+public:
+    VIEW(const ENGINE *engine, int wcell = WCELL, int hcell = HCELL);
+    ~VIEW();
+
+    void reset();
+    void mark_dirty(int events);
+    bool fit(int term_width, int term_height);
+    void draw_background();
+    void draw_boxes();
+    void invalidate(bool blank);
+    void draw_cells();
+    void put_message();
+    void clear_message();
+    void refresh_message();
+    void put_text(const std::vector<std::string> &lines);
+    void draw_game_over();
+    void start_endmovie();
+    bool draw_endmovie();
+    void finish_endmovie();
+
+    int getScreenWidth() const { return screen_width; }
+    int getScreenHeight() const { return screen_height; }
+};
+
+#endif //_VIEW_HPP
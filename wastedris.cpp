@@ -6,38 +6,121 @@
 // 
 
 #include <iostream>
-#include <unistd.h>
+#include <stdio.h> // sscanf
+#include <unistd.h> // getopt
 #include "noncanonical.hpp"
 #include "game_core.hpp"
 
 using namespace std;
 
+static void usage(const char *prog)
+{
+    cerr << "usage: " << prog << " [-d ROWSxCOLS] [-c WxH] [-w replay_to_write] [-r replay_to_play]" << endl;
+}
+
 // ============================================================================== //
 // main
 //
 // Description:
 //   The main function first sets up the environment to a non-canonical mode.
-//   It then repeatedly interacts with the user while updating the state and display.
+//   It then repeatedly reads the user inputs and gives them to the game.
+//   All bytes available are read at once, and decoded into keys in one pass.
+//   The game loop runs in another thread, updating the state and display.
 //   When the user tells to stop or the interaction is supposed to be end,
 //   it breaks the loop.
 //   At the end, it does the final task including deletion of the executable itself.
 // 
+// Options:
+//   -d ROWSxCOLS: the size of the bin in cells (13x11 by default)
+//   -c WxH: the size of a cell in characters (4x3 by default, at least 2x1)
+//           a cell of a single line is compact, e.g., -c 2x1 draws "[]".
+//   -w FILE: record the session to the replay file
+//   -r FILE: play the replay file instead of the user (Ctrl-D still stops it)
+//            the bin has the size of the replay.
+//
 // The condition to break the loop:
-//   when the interaction is supposed to end, e.g., the game is over.
-//   when the user gives Ctrl-D.
+//   when a key is given after the game is over (and the end movie is over or skipped).
+//   when the end movie after Ctrl-D is over or skipped.
+//   when stdin is closed.
 //
 // ============================================================================== //
-int main()
+int main(int argc, char **argv)
 {
+    GAME_OPTION opt;
+    int c_opt;
+    while((c_opt = getopt(argc, argv, "d:c:w:r:")) != -1)
+    {
+        switch(c_opt)
+        {
+        case 'd':
+            if(sscanf(optarg, "%dx%d", &opt.nrow, &opt.ncol) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'c':
+            if(sscanf(optarg, "%dx%d", &opt.wcell, &opt.hcell) != 2)
+            {
+                usage(argv[0]);
+                return 1;
+            }
+            break;
+        case 'w': opt.record_path = optarg; break;
+        case 'r': opt.replay_path = optarg; break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if(opt.replay_path != NULL)
+    {
+        REPLAY_READER reader;
+        if(!reader.open(opt.replay_path))
+        {
+            cerr << "cannot play the replay: " << opt.replay_path << endl;
+            return 1;
+        }
+        opt.nrow = reader.getHeader().nrow;
+        opt.ncol = reader.getHeader().ncol;
+    }
+    if(!ENGINE::isValidSize(opt.nrow, opt.ncol))
+    {
+        cerr << "the bin must be " << MIN_NROW_BIN << "x" << MIN_NCOL_BIN
+             << " to " << MAX_NROW_BIN << "x" << MAX_NCOL_BIN << endl;
+        return 1;
+    }
+    if(opt.wcell < 2 || opt.hcell < 1)
+    {
+        cerr << "a cell must be 2x1 or larger" << endl;
+        return 1;
+    }
+
     int f_fail = set_input_mode();
 
-    GAME* gm = GAME::init_game();
+    GAME* gm = GAME::init_game(opt);
 
-    while(gm->isRunning())
+    KEY_PARSER parser;
+    char buff[256];
+    KEY keys[sizeof(buff) + KEY_PARSER::MAX_PENDING];
+    while(true)
     {
-        char c = readOneChar();
-        gm->play_game(c);
-        usleep(1000);
+        int n = readChars(buff, sizeof(buff), gm->getDoneFd());
+        // the game has finished by itself (e.g., the end movie after Ctrl-D is over)
+        if(n < 0)
+            break;
+        // nothing is read if stdin is closed. it is the same as Ctrl-D.
+        if(n == 0)
+        {
+            gm->play_game(KEY_QUIT);
+            break;
+        }
+        // after the game is over, any key ends the program
+        if(!gm->isRunning() && !gm->isEnding())
+            break;
+        // keys during the end movie skip it
+        int n_keys = parser.parse(buff, n, keys);
+        gm->play_keys(keys, n_keys);
     }
 
     GAME::kill_game();